@@ -104,12 +104,30 @@ obj_Boolean String_method_EQUALS(obj_String this, obj_Obj other) {
   }
 }
 
+/* String:LESS (new method), in strcmp order */
+obj_Boolean String_method_LESS(obj_String this, obj_String other) {
+  if (strcmp(this->text, other->text) < 0) {
+    return lit_true;
+  }
+  return lit_false;
+}
+
+/* String:MORE (new method), in strcmp order */
+obj_Boolean String_method_MORE(obj_String this, obj_String other) {
+  if (strcmp(this->text, other->text) > 0) {
+    return lit_true;
+  }
+  return lit_false;
+}
+
 /* The String Class (a singleton) */
 struct  class_String_struct  the_class_String_struct = {
   new_String,     /* Constructor */
   String_method_STRING, 
   String_method_PRINT, 
-  String_method_EQUALS
+  String_method_EQUALS,
+  String_method_LESS,
+  String_method_MORE
 };
 
 class_String the_class_String = &the_class_String_struct; 
@@ -233,6 +251,7 @@ obj_Nothing nothing = &nothing_struct;
  *    Those of Obj
  *    PLUS
  *    LESS
+ *    MORE
  *    (add more later) 
  * =================
  */
@@ -276,6 +295,14 @@ obj_Boolean Int_method_LESS(obj_Int this, obj_Int other) {
   return lit_false;
 }
 
+/* MORE (new method) */ 
+obj_Boolean Int_method_MORE(obj_Int this, obj_Int other) {
+  if (this->value > other->value) {
+    return lit_true;
+  }
+  return lit_false;
+}
+
 /* PLUS (new method) */
 obj_Int Int_method_PLUS(obj_Int this, obj_Int other) {
   return int_literal(this->value + other->value);
@@ -288,6 +315,7 @@ struct  class_Int_struct  the_class_Int_struct = {
   Obj_method_PRINT, 
   Int_method_EQUALS,
   Int_method_LESS,
+  Int_method_MORE,
   Int_method_PLUS
 };
 
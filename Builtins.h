@@ -5,6 +5,11 @@
 #ifndef Builtins_h
 #define Builtins_h
 
+/* The compiler's picture of these classes, src/BuiltinClasses.h, must
+ * match the class structures here slot for slot; tests/builtins_table.py
+ * checks that it does.
+ */
+
 /* Naming conventions:  
  * class_X: a reference to the class structure (method table) for class X 
  *  * Each class structure will have a single instantiation as the_class_X. 
@@ -90,6 +95,7 @@ struct class_String_struct {
   obj_Boolean (*EQUALS) (obj_String, obj_Obj);
   /* Method table: Introduced in String */
   obj_Boolean (*LESS) (obj_String, obj_String); 
+  obj_Boolean (*MORE) (obj_String, obj_String); 
 };
 
 extern class_String the_class_String;
@@ -185,6 +191,7 @@ extern obj_Nothing nothing;
  *    EQUALS  (override)
  *    and introducing
  *    LESS
+ *    MORE
  *    PLUS    
  *    (add more later) 
  * =================
@@ -205,6 +212,7 @@ struct class_Int_struct {
   obj_Obj (*PRINT) (obj_Obj);      /* Inherited */
   obj_Boolean (*EQUALS) (obj_Int, obj_Obj); /* Overridden */
   obj_Boolean (*LESS) (obj_Int, obj_Int);   /* Introduced */
+  obj_Boolean (*MORE) (obj_Int, obj_Int);   /* Introduced */
   obj_Int (*PLUS) (obj_Int, obj_Int);       /* Introduced */
 };
 
@@ -228,11 +236,14 @@ obj_Boolean Obj_method_EQUALS(obj_Obj this, obj_Obj other);
 obj_String String_method_STRING(obj_String this);
 obj_String String_method_PRINT(obj_String this); 
 obj_Boolean String_method_EQUALS(obj_String this, obj_Obj other); 
+obj_Boolean String_method_LESS(obj_String this, obj_String other);
+obj_Boolean String_method_MORE(obj_String this, obj_String other);
 obj_String Boolean_method_STRING(obj_Boolean this); 
 obj_String Nothing_method_STRING(obj_Nothing this);
 obj_String Int_method_STRING(obj_Int this); 
 obj_Boolean Int_method_EQUALS(obj_Int this, obj_Obj other);
 obj_Boolean Int_method_LESS(obj_Int this, obj_Int other);
+obj_Boolean Int_method_MORE(obj_Int this, obj_Int other);
 obj_Int Int_method_PLUS(obj_Int this, obj_Int other);
 
 #endif
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+#
+# AST size benchmark.  Generates a main program of STATEMENTS
+# statements (assignments, additions, method calls, ifs and whiles
+# over a small class) and compiles it with -m and --time-report=json.
+# Prints the AST's node count and size, the arena, the time of the
+# phases that walk the tree, and peak RSS.
+#
+#     python3 ast_size.py [parser] [statements]
+#
+# parser defaults to ../bin/parser next to this script; statements to
+# 100000.
+#
+
+import random
+import re
+import sys
+
+import benchlib
+
+HEADER = '''class Counter(n: Int) {
+    this.n = n;
+    def add(k: Int): Counter { return Counter(this.n + k); }
+    def big(): Boolean { return this.n > 1000; }
+}
+c = Counter(0);
+i = 0;
+s = "";
+'''
+
+
+def statement(rng):
+    r = rng.random()
+    if r < 0.4:
+        return "i = i + %d + (i + %d);\n" % (rng.randrange(1, 9), rng.randrange(100))
+    if r < 0.6:
+        return "c = c.add(i + %d);\n" % rng.randrange(100)
+    if r < 0.75:
+        return "s = \"%d\";\n" % rng.randrange(1000)
+    if r < 0.9:
+        return "if i > %d and not (i == 7) { i = i + 1; } else { c = c.add(1); }\n" % rng.randrange(100)
+    return "while i > %d { i = i + 2; }\n" % rng.randrange(10)
+
+
+def program(statements):
+    rng = random.Random(7)
+    return HEADER + "".join(statement(rng) for _ in range(statements))
+
+
+def main():
+    parser = benchlib.parser_path(sys.argv)
+    statements = int(sys.argv[2]) if len(sys.argv) > 2 else 100000
+    with benchlib.scratch() as work:
+        path = benchlib.write(work, "ast.qk", program(statements))
+        report, result = benchlib.time_report(parser, path, work, ["-m"])
+        text = result.out + result.err
+        nodes = re.search(r"AST: (\d+) nodes in (\d+) bytes", text)
+        arena = re.search(r"Arena: (\d+) bytes", text)
+        print("ast_size: %d statements, %d AST nodes, AST %.1f MB, arena %d KB"
+              % (statements, int(nodes.group(1)), int(nodes.group(2)) / 1048576.0,
+                 int(arena.group(1)) // 1024))
+        for phase in ("parse", "initcheck", "typeCheck", "generate_code"):
+            print("  %-14s %8.1f ms" % (phase, benchlib.phase_ms(report, phase)[0]))
+        print("  %-14s %8.1f ms, peak RSS %d MB, exit %d"
+              % ("total", report["total"]["wall_ms"], result.rss_kb // 1024, result.status))
+
+
+if __name__ == "__main__":
+    main()
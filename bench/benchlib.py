@@ -0,0 +1,81 @@
+#
+# What the benchmarks in this directory share: finding the parser,
+# running it on a generated program in a scratch directory, and reading
+# its --time-report=json.
+#
+
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def parser_path(argv, index=1):
+    """argv[index] if given, else ../bin/parser next to this script"""
+    if len(argv) > index:
+        return os.path.abspath(argv[index])
+    return os.path.abspath(os.path.join(HERE, "..", "bin", "parser"))
+
+
+def scratch():
+    """A directory for the generated programs and quackmain.c"""
+    return tempfile.TemporaryDirectory(prefix="quack-bench-")
+
+
+def write(work, name, text):
+    path = os.path.join(work, name)
+    with open(path, "w") as out:
+        out.write(text)
+    return path
+
+
+class Run:
+    """One run of the parser: exit status, wall seconds, peak RSS (KB), stdout, stderr"""
+
+    def __init__(self, status, seconds, rss_kb, out, err):
+        self.status = status
+        self.seconds = seconds
+        self.rss_kb = rss_kb
+        self.out = out
+        self.err = err
+
+
+def run(parser, args, work):
+    """Run parser with args in work and wait for it"""
+    with tempfile.TemporaryFile() as out, tempfile.TemporaryFile() as err:
+        start = time.time()
+        child = subprocess.Popen([parser] + args, cwd=work, stdout=out, stderr=err)
+        _, status, usage = os.wait4(child.pid, 0)
+        seconds = time.time() - start
+        out.seek(0)
+        err.seek(0)
+        exit_status = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -os.WTERMSIG(status)
+        return Run(exit_status, seconds, usage.ru_maxrss,
+                   out.read().decode(errors="replace"), err.read().decode(errors="replace"))
+
+
+def time_report(parser, source, work, extra=()):
+    """Compile source with --time-report=json; returns (report dict, Run)"""
+    result = run(parser, ["--time-report=json"] + list(extra) + [source], work)
+    for line in result.err.splitlines():
+        if line.startswith("{"):
+            return json.loads(line), result
+    sys.stdout.write(result.err[-1000:])
+    raise SystemExit("%s: no time report (exit %d)" % (source, result.status))
+
+
+def phase_ms(report, name):
+    """(wall, cpu) ms of the named phase in a time report"""
+    for phase in report["phases"]:
+        if phase["name"] == name:
+            return phase["wall_ms"], phase["cpu_ms"]
+    return 0.0, 0.0
+
+
+def best_of(repeat, measure):
+    """The smallest of repeat calls to measure(), which returns a number"""
+    return min(measure() for _ in range(repeat))
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+#
+# Branch scaling benchmark.  Generates a main program with an if/elif
+# chain of ARMS arms, each assigning the same LOCALS variables, and a
+# method with a typecase of ARMS arms, then compiles it with
+# --time-report=json.  Prints the initcheck and typeCheck times per arm,
+# which should stay flat as the chains grow.
+#
+#     python3 branch_scaling.py [parser] [arms] [locals] [repeat]
+#
+# parser defaults to ../bin/parser next to this script; arms to 4000
+# and locals to 200.  Each program is compiled at 1/4, 1/2 and all of
+# arms; the best of repeat (default 3) runs is shown.
+#
+
+import sys
+
+import benchlib
+
+
+def typecase(arms):
+    text = ["class T(n: Int) extends Obj {\n    this.n = n;\n",
+            "    def pick(o: Obj): Int {\n        r = 0;\n        typecase o {\n"]
+    for a in range(arms):
+        text.append("            v%d: Int { r = r + v%d + %d; }\n" % (a, a, a))
+    text.append("        }\n        return r;\n    }\n}\n")
+    return "".join(text)
+
+
+def chain(arms, names):
+    assigns = "".join("    x%d = i + %d;\n" % (v, v) for v in range(names))
+    text = ["i = 0;\n"]
+    for a in range(arms):
+        text.append("%s i > %d {\n%s}" % ("if" if a == 0 else " elif", a, assigns))
+    text.append(" else {\n%s}\n" % assigns)
+    text.append("y = x0 + x%d;\n" % (names - 1))
+    return "".join(text)
+
+
+def main():
+    parser = benchlib.parser_path(sys.argv)
+    arms = int(sys.argv[2]) if len(sys.argv) > 2 else 4000
+    names = int(sys.argv[3]) if len(sys.argv) > 3 else 200
+    repeat = int(sys.argv[4]) if len(sys.argv) > 4 else 3
+    with benchlib.scratch() as work:
+        for size in (arms // 4, arms // 2, arms):
+            path = benchlib.write(work, "branches.qk", typecase(size) + chain(size, names))
+
+            def measure():
+                report, result = benchlib.time_report(parser, path, work)
+                return (benchlib.phase_ms(report, "initcheck")[0]
+                        + benchlib.phase_ms(report, "typeCheck")[0])
+
+            ms = benchlib.best_of(repeat, measure)
+            print("branch_scaling: %6d arms %4d locals  initcheck+typeCheck %8.1f ms  %7.2f us/arm"
+                  % (size, names, ms, 1000.0 * ms / size))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+#
+# Parallel type checking benchmark.  Generates a program of CLASSES
+# classes with METHODS methods each (loops, arithmetic, calls and field
+# reads over a few locals), and compiles it with --check-threads=N and
+# --time-report=json for N = 1, 2, 4, ... up to the number of cores.
+# Prints the typeCheck time and speedup over one thread, and checks
+# that every run printed the same messages and generated the same C.
+#
+#     python3 check_threads.py [parser] [classes] [methods] [repeat]
+#
+# parser defaults to ../bin/parser next to this script; classes to 200
+# and methods to 20 (4000 methods).  The best of repeat (default 3)
+# runs is shown.
+#
+
+import os
+import sys
+
+import benchlib
+
+
+def method(c, m):
+    return '''    def m%(m)d(k: Int): Int {
+        total = this.n + k;
+        i = 0;
+        while %(m)d > i {
+            total = total + i + k;
+            if total > 1000 { total = this.n; } else { total = total + this.n; }
+            i = i + 1;
+        }
+        other = K%(p)d(total);
+        return total + other.n;
+    }
+''' % {"m": m, "p": max(c - 1, 0)}
+
+
+def program(classes, methods):
+    text = []
+    for c in range(classes):
+        parent = "K%d" % (c - 1) if c > 0 else "Obj"
+        text.append("class K%d(n: Int) extends %s {\n    this.n = n;\n" % (c, parent))
+        text.extend(method(c, m) for m in range(methods))
+        text.append("}\n")
+    text.append("x = K%d(1).m0(2);\n" % (classes - 1))
+    return "".join(text)
+
+
+def main():
+    parser = benchlib.parser_path(sys.argv)
+    classes = int(sys.argv[2]) if len(sys.argv) > 2 else 200
+    methods = int(sys.argv[3]) if len(sys.argv) > 3 else 20
+    repeat = int(sys.argv[4]) if len(sys.argv) > 4 else 3
+    cores = os.cpu_count() or 1
+    counts = [1]
+    while counts[-1] * 2 <= cores:
+        counts.append(counts[-1] * 2)
+    with benchlib.scratch() as work:
+        path = benchlib.write(work, "threads.qk", program(classes, methods))
+        c_path = os.path.join(work, "threads.c")
+        baseline = None
+        serial_ms = None
+        for threads in counts:
+            outputs = []
+
+            def measure():
+                report, result = benchlib.time_report(parser, path, work, ["--check-threads=%d" % threads])
+                with open(c_path) as c_code:
+                    outputs.append((result.status, result.out, c_code.read()))
+                return benchlib.phase_ms(report, "typeCheck")[0]
+
+            ms = benchlib.best_of(repeat, measure)
+            if baseline is None:
+                baseline = outputs[0]
+                serial_ms = ms
+            if any(output != baseline for output in outputs):
+                raise SystemExit("--check-threads=%d: output differs from one thread" % threads)
+            print("check_threads: %d methods, %2d threads  typeCheck %8.1f ms  speedup %5.2fx"
+                  % (classes * methods, threads, ms, serial_ms / ms if ms > 0 else 0.0))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+#
+# Class hierarchy validation benchmark.  Generates a wide hierarchy of
+# CLASSES classes (each extending the class numbered a tenth of its own)
+# and a chain of CLASSES / 2 classes (each extending the one before),
+# and compiles each with --time-report=json.  Prints the time of the
+# toposort pass, which checks the hierarchy and orders it; it should
+# grow linearly with the number of classes, however deep they nest.
+#
+#     python3 hierarchy_scaling.py [parser] [classes] [repeat]
+#
+# parser defaults to ../bin/parser next to this script; classes to
+# 100000.  The best of repeat (default 3) runs is shown.
+#
+
+import sys
+
+import benchlib
+
+
+def wide(classes):
+    return "".join("class W%d() extends %s { }\n" % (i, "W%d" % (i // 10) if i >= 10 else "Obj")
+                   for i in range(classes))
+
+
+def chain(classes):
+    return "".join("class C%d() extends %s { }\n" % (i, "C%d" % (i - 1) if i > 0 else "Obj")
+                   for i in range(classes))
+
+
+def main():
+    parser = benchlib.parser_path(sys.argv)
+    classes = int(sys.argv[2]) if len(sys.argv) > 2 else 100000
+    repeat = int(sys.argv[3]) if len(sys.argv) > 3 else 3
+    with benchlib.scratch() as work:
+        for shape, make, size in (("wide", wide, classes), ("chain", chain, classes // 2)):
+            path = benchlib.write(work, "hierarchy.qk", make(size))
+
+            def measure():
+                report, result = benchlib.time_report(parser, path, work)
+                if result.status != 0:
+                    raise SystemExit("%s of %d classes: exit %d" % (shape, size, result.status))
+                return benchlib.phase_ms(report, "toposort")[0]
+
+            ms = benchlib.best_of(repeat, measure)
+            print("hierarchy_scaling: %-5s %7d classes  toposort %8.2f ms" % (shape, size, ms))
+
+
+if __name__ == "__main__":
+    main()
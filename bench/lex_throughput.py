@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+#
+# Lexer throughput benchmark.  Generates a Quack source of SIZE MB
+# (identifiers, keywords, numbers, punctuation, comments, and string
+# literals with and without escapes, including triple-quoted ones) and
+# scans it with `parser -l`, which reads the file without parsing and
+# prints its tokens, bytes and MB/s.
+#
+#     python3 lex_throughput.py [parser] [size MB] [repeat]
+#
+# parser defaults to ../bin/parser next to this script; size to 16 MB.
+# Prints the best of repeat (default 5) scans.
+#
+
+import re
+import sys
+
+import benchlib
+
+CLASS = '''/* Class %(n)d: a block comment
+ * of a few lines
+ */
+class Item%(n)d(count: Int, label: String) extends Obj {
+    this.count = count;
+    this.label = label;   // trailing comment
+    def bump(by: Int): Item%(n)d {
+        total = this.count + by * 2 - 1;
+        if total >= 1000 and not (total == 1001) {
+            note = "plain literal without escapes";
+        } elif total <= 10 or total < 3 {
+            note = "tab\\there, newline\\n, quote\\" done";
+        } else {
+            note = """triple-quoted
+literal spanning lines""";
+        }
+        while total > 0 { total = total / 2; }
+        return Item%(n)d(total, note);
+    }
+}
+'''
+
+
+def source(megabytes):
+    parts = []
+    size = 0
+    n = 0
+    while size < megabytes * 1024 * 1024:
+        text = CLASS % {"n": n}
+        parts.append(text)
+        size += len(text)
+        n += 1
+    return "".join(parts)
+
+
+def main():
+    parser = benchlib.parser_path(sys.argv)
+    megabytes = float(sys.argv[2]) if len(sys.argv) > 2 else 16
+    repeat = int(sys.argv[3]) if len(sys.argv) > 3 else 5
+    with benchlib.scratch() as work:
+        path = benchlib.write(work, "lex.qk", source(megabytes))
+        best = None
+        for _ in range(repeat):
+            result = benchlib.run(parser, ["-l", path], work)
+            if result.status != 0:
+                sys.stdout.write(result.out[-1000:] + result.err[-1000:])
+                raise SystemExit("parser -l failed (exit %d)" % result.status)
+            # "<file>: T tokens, B bytes in M ms (R MB/s)"
+            found = re.search(r"(\d+) tokens, (\d+) bytes in ([\d.e+-]+) ms", result.out)
+            tokens, size, ms = int(found.group(1)), int(found.group(2)), float(found.group(3))
+            if best is None or ms < best[2]:
+                best = (tokens, size, ms)
+        tokens, size, ms = best
+        print("lex_throughput: %d tokens, %.1f MB in %.1f ms: %.1f MB/s, %.1f M tokens/s (best of %d)"
+              % (tokens, size / (1024.0 * 1024.0), ms, size / (1024.0 * 1024.0) / (ms / 1000),
+                 tokens / 1e6 / (ms / 1000), repeat))
+
+
+if __name__ == "__main__":
+    main()
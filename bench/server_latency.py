@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+#
+# Compile server latency benchmark.  Starts `parser --server` on a
+# socket in a scratch directory and runs `quack-client -b N` against
+# it, which times N cold bin/parser processes against N requests to
+# the warm server, then stops the server.
+#
+#     python3 server_latency.py [parser] [runs] [file.qk ...]
+#
+# parser defaults to ../bin/parser next to this script, and the client
+# is quack-client next to it.  runs defaults to 50; the files to
+# samples/short.qk and samples/robot.qk.
+#
+
+import os
+import signal
+import subprocess
+import sys
+import time
+
+import benchlib
+
+
+def main():
+    parser = benchlib.parser_path(sys.argv)
+    client = os.path.join(os.path.dirname(parser), "quack-client")
+    runs = sys.argv[2] if len(sys.argv) > 2 else "50"
+    samples = os.path.join(benchlib.HERE, "..", "samples")
+    files = [os.path.abspath(f) for f in sys.argv[3:]] or \
+        [os.path.abspath(os.path.join(samples, f)) for f in ("short.qk", "robot.qk")]
+    with benchlib.scratch() as work:
+        socket = os.path.join(work, "quack.sock")
+        server = subprocess.Popen([parser, "--server", socket], cwd=work, stdout=subprocess.DEVNULL)
+        try:
+            for _ in range(100):
+                if os.path.exists(socket) or server.poll() is not None:
+                    break
+                time.sleep(0.05)
+            if not os.path.exists(socket):
+                raise SystemExit("server did not start")
+            failures = 0
+            for path in files:
+                result = subprocess.run([client, "-b", runs, "-p", parser, socket, path], cwd=work)
+                failures += result.returncode != 0
+        finally:
+            server.send_signal(signal.SIGTERM)
+            server.wait()
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
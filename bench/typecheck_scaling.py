@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+#
+# Type checking scaling benchmark.  Generates programs with a chain of
+# DEPTH classes, each extending the one before, and a main program of
+# STATEMENTS statements that construct objects at random depths and
+# call inherited methods on them, then compiles each with
+# --time-report=json.  Prints the typeCheck time per statement, which
+# should stay flat as either the program or the hierarchy grows.
+#
+#     python3 typecheck_scaling.py [parser] [statements] [repeat]
+#
+# parser defaults to ../bin/parser next to this script; statements to
+# 20000.  Each size is compiled at 1/4, 1/2 and all of statements, for
+# hierarchies of 8, 64 and 512 classes; the best of repeat (default 3)
+# runs is shown.
+#
+
+import random
+import sys
+
+import benchlib
+
+
+def classes(depth):
+    text = ['''class C0(n: Int) extends Obj {
+    this.n = n;
+    def grow(k: Int): C0 { return C0(this.n + k); }
+    def big(): Boolean { return this.n > 1000; }
+}
+''']
+    for d in range(1, depth):
+        text.append('''class C%d(n: Int) extends C%d {
+    this.n = n;
+    def step%d(): Int { return this.n + %d; }
+}
+''' % (d, d - 1, d, d))
+    return "".join(text)
+
+
+def statement(rng, depth):
+    d = rng.randrange(depth)
+    r = rng.random()
+    if r < 0.4:
+        return "x = C%d(i);\n" % d
+    if r < 0.7:
+        return "x = x.grow(%d);\n" % rng.randrange(100)
+    if r < 0.9:
+        d = max(d, 1)
+        return "i = C%d(i).step%d() + 1;\n" % (d, d)
+    return "if x.big() { i = i + 1; }\n"
+
+
+def program(depth, statements):
+    rng = random.Random(depth * 1000003 + statements)
+    return (classes(depth) + "i = 0;\nx = C0(0);\n"
+            + "".join(statement(rng, depth) for _ in range(statements)))
+
+
+def main():
+    parser = benchlib.parser_path(sys.argv)
+    statements = int(sys.argv[2]) if len(sys.argv) > 2 else 20000
+    repeat = int(sys.argv[3]) if len(sys.argv) > 3 else 3
+    with benchlib.scratch() as work:
+        for depth in (8, 64, 512):
+            for size in (statements // 4, statements // 2, statements):
+                path = benchlib.write(work, "scaling.qk", program(depth, size))
+
+                def measure():
+                    report, result = benchlib.time_report(parser, path, work)
+                    if result.status != 0:
+                        raise SystemExit("%d classes, %d statements: exit %d"
+                                         % (depth, size, result.status))
+                    return benchlib.phase_ms(report, "typeCheck")[0]
+
+                ms = benchlib.best_of(repeat, measure)
+                print("typecheck_scaling: %4d classes %7d statements  typeCheck %8.1f ms  %6.2f us/statement"
+                      % (depth, size, ms, 1000.0 * ms / size))
+
+
+if __name__ == "__main__":
+    main()
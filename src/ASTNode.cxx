@@ -4,327 +4,920 @@
 
 #include "ASTNode.h"
 #include "staticsemantics.cxx"
-#include <typeinfo>
 
 using namespace std;
 
 namespace AST {
-    // Abstract syntax tree.  ASTNode is abstract base class for all other nodes.
-
-    void Method::genR(Context *con, string targreg) {
-        string methodname = name_.get_var();
-        Context *copycon = new Context(*con);
-        copycon->methodname = methodname;
-        TypeNode classnode = con->ssc->hierarchy[copycon->classname];
-        MethodTable mt = classnode.methods[methodname];
-        copycon->emit("");
-        if (copycon->classname == methodname) { // constructor
-            copycon->emit("obj_" + methodname + " new_" + methodname + "(" + copycon->get_formal_argtypes("constructor") + ") {");
-            copycon->emit("obj_" + methodname + " new_thing = (obj_" + methodname + ") malloc(sizeof(struct obj_" + methodname + "_struct));");
-            copycon->emit("new_thing->clazz = the_class_" + methodname + ";");
-        }
-        else { // not constructor
-            copycon->emit("obj_" + mt.returntype + " " + copycon->classname + "_method_" + methodname + "(" + copycon->get_formal_argtypes(methodname) + ") {");
-        }
-        statements_.genR(copycon, targreg);
-        copycon->emit("}");
-        copycon->emit("");
-    }
+    // Abstract syntax tree.  Each pass is a walk over the tree (see Walk
+    // in ASTNode.h) that switches on the kind of node; see ASTNode.h for
+    // the children of each kind.  Where the work for a node is split by
+    // its children, step says how many of those pieces are done.
+
+    /* Code generation: genR (value into a register), genL (location, or
+     * the registers of the actual arguments) and genBranch (jump on a
+     * condition) are one walk, since each of them starts the others.
+     */
+    class CodeGen {
+    public:
+        enum Op { R, L, Branch };
+    private:
+        struct Frame {
+            ASTNode node;
+            Op op;
+            int step = 0;
+            uint32_t i = 0;             // Next element of a sequence
+            Context* con;
+            string reg;                 // R: the target register
+            string a, b, c;             // Registers and labels kept across children
+            vector<string> regs;        // Actuals: a register per argument
+            Frame(ASTNode node, Op op, Context* con, string reg) : node{node}, op{op}, con{con}, reg{reg} {}
+        };
+        Walk<Frame> walk_;
+        string result_;                 // What the last finished L frame produced
 
-    int Program::initcheck(set<string>* vars, StaticSemantics* ssc) {
-        for (map<string, TypeNode>::iterator iter = ssc->hierarchy.begin(); iter != ssc->hierarchy.end(); ++iter) {
-            vars->insert(iter->first); // insert class name as constructor
-            TypeNode classnode = iter->second;
-            map<string, MethodTable> methods = classnode.methods;
-            for(map<string, MethodTable>::iterator iter = methods.begin(); iter != methods.end(); ++iter) {
-                vars->insert(iter->first); // insert method name
+        void call(Frame& f, int next, Op op, ASTNode node, Context* con, string reg = "") {
+            f.step = next;
+            walk_.push(node, op, con, reg);
+        }
+        void branch(Frame& f, int next, ASTNode cond, Context* con, string true_branch, string false_branch) {
+            f.step = next;
+            Frame& b = walk_.push(cond, Branch, con, "");
+            b.a = true_branch;  // Branch frames keep their labels in a and b
+            b.b = false_branch;
+        }
+        void done(string result = "") {
+            result_ = result;
+            walk_.pop();
+        }
+        void genR(Frame& f);
+        void genL(Frame& f);
+        void genBranch(Frame& f);
+    public:
+        string run(ASTNode node, Op op, Context* con, string reg, string true_branch = "", string false_branch = "") {
+            Frame& f = walk_.push(node, op, con, reg);
+            f.a = true_branch;
+            f.b = false_branch;
+            while (!walk_.empty()) {
+                Frame& top = walk_.top();
+                switch (top.op) {
+                case R: genR(top); break;
+                case L: genL(top); break;
+                case Branch: genBranch(top); break;
+                }
             }
+            return result_;
+        }
+    };
+
+    void CodeGen::genL(Frame& f) {
+        ASTNode n = f.node;
+        Context* con = f.con;
+        switch (n.kind()) {
+        case Kind::Ident:
+            return done(con->get_local_var(n.text()));
+        case Kind::Load:
+            return done(con->get_local_var(n.get_var()));
+        case Kind::Dot: {
+            // A field the checker resolved is obj->x, at its slot of the
+            // object's struct; otherwise the variable named this.x
+            Symbol field = con->ssc->field_of(n);
+            if (field.empty()) { return done(con->get_local_var(con->ssc->var_name(n))); }
+            if (f.step == 0) {
+                f.a = con->alloc_reg(con->get_type(n.child(0)));
+                return call(f, 1, R, n[0], con, f.a);
+            }
+            return done(f.a + "->" + field.str());
+        }
+        case Kind::Actuals: {
+            if (f.i < n.size()) {
+                ASTNode actual = n[f.i++];
+                Symbol type = con->get_type(actual);
+                string reg = con->alloc_reg(type);
+                f.regs.push_back(reg);
+                return call(f, 1, R, actual, con, reg);
+            }
+            // The registers, separated by ", "; none for a call without arguments
+            string actuals = "";
+            for (const string& reg: f.regs) {
+                if (!actuals.empty()) { actuals += ", "; }
+                actuals += reg;
+            }
+            return done(actuals);
+        }
+        default:
+            report::out() << "GENL UNIMP" << endl;
+            return done();
         }
-        if (classes_.initcheck(vars)) {return 1;}
-        if (statements_.initcheck(vars)) {return 1;}
-        return 0;
     }
 
-    string Ident::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info) {
-        if (text_ == "this") {
-            TypeNode classnode = ssc->hierarchy[info->classname];
-            map<string, string> instancevars = classnode.instance_vars;
-            if (instancevars.count(text_)) {return instancevars[text_];}
-            else { return "TypeErrorthissss";}
+    void CodeGen::genR(Frame& f) {
+        ASTNode n = f.node;
+        Context* con = f.con;
+        string targreg = f.reg;
+        switch (n.kind()) {
+        case Kind::Program: {
+            if (f.step == 0) { return call(f, 1, R, n[0], con, targreg); }
+            if (f.step == 1) {
+                Context* classcon = Arena::current()->make<Context>(*con); // copy constructor
+                classcon->classname = sym::pgm;
+                classcon->methodname = sym::pgm;
+                return call(f, 2, R, n[1], classcon, targreg);
+            }
+            return done();
+        }
+        case Kind::Classes:
+            if (f.i < n.size()) {
+                ASTNode cls = n[f.i++];
+                Symbol classname = cls.child(0).get_var();
+                Context* classcon = Arena::current()->make<Context>(*con); // copy constructor
+                classcon->classname = classname;
+                return call(f, 1, R, cls, classcon, targreg);
+            }
+            return done();
+        case Kind::Methods:
+        case Kind::Formals:
+        case Kind::Block:
+        case Kind::Actuals:
+        case Kind::Type_Alternatives:
+            if (f.i < n.size()) { return call(f, 1, R, n[f.i++], con, targreg); }
+            return done();
+        case Kind::Class: {
+            if (f.step == 0) {
+                Symbol classname = n.child(0).get_var();
+                con->emit("struct class_", classname, "_struct;");
+                con->emit("struct obj_", classname, ";");
+                con->emit("typedef struct obj_", classname, "* obj_", classname, ";");
+                con->emit("typedef struct class_", classname, "_struct* class_", classname, ";");
+                con->emit("");
+                con->emit("typedef struct obj_", classname, "_struct {");
+                con->emit("class_", classname, " clazz;");
+                con->emit_instance_vars();
+                con->emit("} * obj_", classname, ";");
+                con->emit("");
+                con->emit("struct class_", classname, "_struct the_class_", classname, "_struct;");
+                con->emit("");
+                con->emit("struct class_", classname, "_struct {");
+                // constructor
+                con->emit("obj_", classname, " (*constructor) (", con->get_formal_argtypes(sym::constructor), ");");
+                con->emit_method_sigs(); // rest of the methods
+                con->emit("};\n");
+                con->emit("extern class_", classname, " the_class_", classname, ";");
+                // now populate constructor
+                con->emit("");
+                Context * construct_con = Arena::current()->make<Context>(*con);
+                construct_con->methodname = sym::constructor;
+                return call(f, 1, R, n[2], construct_con, targreg);
+            }
+            if (f.step == 1) { return call(f, 2, R, n[3], con, targreg); }
+            con->emit_the_class_struct();
+            return done();
+        }
+        case Kind::Method: {
+            if (f.step == 0) {
+                Symbol methodname = n.child(0).get_var();
+                Context *copycon = Arena::current()->make<Context>(*con);
+                copycon->methodname = methodname;
+                copycon->emit("");
+                if (copycon->classname == methodname) { // constructor
+                    string params = copycon->bind_formals(n[1]);
+                    copycon->emit("obj_", methodname, " new_", methodname, "(", params, ") {");
+                    copycon->emit("obj_", methodname, " new_thing = (obj_", methodname, ") malloc(sizeof(struct obj_", methodname, "_struct));");
+                    copycon->emit("new_thing->clazz = the_class_", methodname, ";");
+                    copycon->bind_local(sym::this_, "new_thing");
+                }
+                else { // not constructor: the receiver comes first, as this
+                    Symbol returntype = con->ssc->find_method(copycon->classname, methodname)->returntype;
+                    copycon->bind_local(sym::this_, "this");
+                    string params = "obj_" + copycon->classname.str() + " this";
+                    string formals = copycon->bind_formals(n[1]);
+                    if (!formals.empty()) { params += ", " + formals; }
+                    copycon->emit("obj_", returntype, " ", copycon->classname, "_method_", methodname, "(", params, ") {");
+                }
+                f.con = copycon;
+                return call(f, 1, R, n[3], copycon, targreg);
+            }
+            con->emit("}");
+            con->emit("");
+            return done();
         }
-        if (vt->count(text_)) { // Identifier in table
-            return (*vt)[text_];
+        case Kind::Assign:
+        case Kind::AssignDeclare: {
+            if (f.step == 0) {
+                ASTNode lexpr = n.child(0);
+                Symbol type = con->get_type(lexpr);
+                f.a = con->alloc_reg(type);
+                return call(f, 1, L, lexpr, con);
+            }
+            if (f.step == 1) {
+                f.b = result_;  // the location
+                return call(f, 2, R, n[1], con, f.a);
+            }
+            /* Store the value in the location */
+            con->emit(f.b, " = ", f.a, ";");
+            return done();
+        }
+        case Kind::If: {
+            // a, b, c: the 'then', 'else' and 'endif' labels
+            if (f.step == 0) {
+                f.a = con->new_branch_label("then");
+                f.b = con->new_branch_label("else");
+                f.c = con->new_branch_label("endif");
+                return branch(f, 1, n[0], con, f.a, f.b);
+            }
+            if (f.step == 1) {
+                /* Generate the 'then' part here */
+                con->emit(f.a, ": ;");
+                return call(f, 2, R, n[1], con, targreg);
+            }
+            if (f.step == 2) {
+                con->emit("goto ", f.c, ";");
+                /* Generate the 'else' part here */
+                con->emit(f.b, ": ;");
+                return call(f, 3, R, n[2], con, targreg);
+            }
+            /* That's all, folks */
+            con->emit(f.c, ": ;");
+            return done();
+        }
+        case Kind::While: {
+            // a, b, c: the 'check_cond', 'loop' and 'endwhile' labels
+            if (f.step == 0) {
+                f.a = con->new_branch_label("check_cond");
+                f.b = con->new_branch_label("loop");
+                f.c = con->new_branch_label("endwhile");
+                con->emit(f.a, ": ;");
+                return branch(f, 1, n[0], con, f.b, f.c);
+            }
+            if (f.step == 1) {
+                con->emit(f.b, ": ;");
+                return call(f, 2, R, n[1], con, targreg);
+            }
+            con->emit("goto ", f.a, ";");
+            con->emit(f.c, ": ;");
+            return done();
+        }
+        case Kind::Ident: {
+            /* The lvalue, i.e., address of memory */
+            string loc = con->get_local_var(n.text());
+            con->emit(targreg, " = ", loc, ";");
+            return done();
+        }
+        case Kind::Load:
+            if (f.step == 0) { return call(f, 1, R, n[0], con, targreg); }
+            return done();
+        case Kind::Dot: {
+            Symbol field = con->ssc->field_of(n);
+            if (field.empty()) {
+                con->emit(targreg, " = ", con->get_local_var(con->ssc->var_name(n)), ";");
+                return done();
+            }
+            if (f.step == 0) {
+                f.a = con->alloc_reg(con->get_type(n.child(0)));
+                return call(f, 1, R, n[0], con, f.a);
+            }
+            con->emit(targreg, " = ", f.a, "->", field, ";");
+            return done();
+        }
+        case Kind::IntConst:
+            con->emit(targreg, " = int_literal(", n.int_value(), ");");
+            return done();
+        case Kind::StrConst:
+            con->emit(targreg, " = str_literal(", n.literal(), ");");
+            return done();
+        case Kind::Call: {
+            //obj_Int x_sum = this_x->clazz->PLUS(this_x, other_x);
+            if (f.step == 0) {
+                ASTNode receiver = n.child(0);
+                Symbol recvtype = con->get_type(receiver);
+                f.a = con->alloc_reg(recvtype);
+                return call(f, 1, R, receiver, con, f.a);
+            }
+            if (f.step == 1) { return call(f, 2, L, n[2], con); }
+            Symbol methodname = n.child(1).get_var();
+            string args = result_.empty() ? f.a : f.a + ", " + result_;  // the receiver, then the actuals
+            con->emit(targreg, " = ", f.a, "->clazz->", methodname, "(", args, ");");
+            return done();
         }
-        else { // not in table!!
-            cout << "TypeError: Identifier " << text_ << " uninitialized" << endl;
-            return "TypeError"; // error?? 
+        default:
+            report::out() << "GENR UNIMPLLLL" << endl;
+            return done();
         }
     }
 
-    string Dot::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info) { 
-        string lhs_type = left_.type_infer(ssc, vt, info); 
-        right_.type_infer(ssc, vt, info);
-        string rhs_id = right_.get_var();
-        string lhs_id = left_.get_var();
-        map<string, TypeNode> hierarchy = ssc->hierarchy;
-        TypeNode classnode = hierarchy[lhs_type];
-        map<string, string> instancevars = classnode.instance_vars;
-        if (instancevars.count(rhs_id)) {
-            return instancevars[rhs_id];
-        }
-        return "Dot:TypeError";
-    }    
-
-    string Program::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info) { 
-        classes_.type_infer(ssc, vt, info);
-        class_and_method* pgminfo = new class_and_method("__pgm__", "");
-        map<string, string>* pgmvt = &(ssc->hierarchy)["__pgm__"].instance_vars;
-        statements_.type_infer(ssc, pgmvt, pgminfo);
-        return "Nothing";
+    void CodeGen::genBranch(Frame& f) {
+        ASTNode n = f.node;
+        Context* con = f.con;
+        if (n.kind() != Kind::Call) {
+            report::out() << "GENBRANCH UNIMP" << endl;
+            return done();
+        }
+        // At present, we don't have 'and' and 'or'
+        if (f.step == 0) {
+            Symbol mytype = con->get_type(n);
+            f.c = con->alloc_reg(mytype);
+            return call(f, 1, R, n, con, f.c);
+        }
+        con->emit("if (", f.c, ") goto ", f.a, ";");
+        con->emit("goto ", f.b, ";");
+        con->free_reg(f.c);
+        return done();
     }
 
-    string Typecase::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info) {
-        expr_.type_infer(ssc, vt, info);
-        cases_.type_infer(ssc, vt, info);
-        return "Nothing";
+    string ASTNode::genL(Context *con) const {
+        CodeGen gen;
+        return gen.run(*this, CodeGen::L, con, "");
     }
 
-    string Type_Alternative::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info) {
-        ident_.type_infer(ssc, vt, info);
-        classname_.type_infer(ssc, vt, info);
-        // copy table
-        map<string, string>* localvt = new map<string, string>(*vt);
-        (*localvt)[ident_.get_var()] = classname_.get_var();
-        block_.type_infer(ssc, localvt, info);
-        // TODO: do we need to put any changes to the local vars here into the original vt?? to make sure we start
-        // where we left off next iteration?
-        return "Nothing";
+    void ASTNode::genR(Context *con, string targreg) const {
+        CodeGen gen;
+        gen.run(*this, CodeGen::R, con, targreg);
     }
 
-    string Construct::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info) { 
-        //cout << "ENTERING Construct::type_infer" << endl;
-        // recursive call to type-check actual args
-        actuals_.type_infer(ssc, vt, info);
-        // verify that the construct call matches signature
-        map<string, TypeNode> hierarchy = ssc->hierarchy;
-        string methodname = method_.get_var();
-        TypeNode classnode = hierarchy[methodname]; // method name same as class name
-        MethodTable constructortable = classnode.construct;        
-        if (constructortable.formalargtypes.size() != actuals_.elements_.size()) {
-            cout << "Error (Construct): number of actual args (" << actuals_.elements_.size()
-                            << ") does not match method signature (" << constructortable.formalargtypes.size() 
-                            << ") for call: " << methodname << "(...)" << endl;
-            return "Construct:TypeError";
-        }
-        for (int i = 0; i < actuals_.elements_.size(); i++) {
-            string formaltype = constructortable.formalargtypes[i];
-            string actualtype = actuals_.elements_[i]->type_infer(ssc, vt, info);
-            if (!ssc->is_subtype(actualtype, formaltype)) {
-                cout << "Error (Construct): actual args do not match method signature for constructor call: "
-                                        << methodname << "(...)" << endl;
-                return "Construct:TypeError";
+    void ASTNode::genBranch(Context *con, string true_branch, string false_branch) const {
+        CodeGen gen;
+        gen.run(*this, CodeGen::Branch, con, "", true_branch, false_branch);
+    }
+
+    void ASTNode::collect_vars(map<Symbol, Symbol>* vt) const {
+        switch (kind()) {
+        case Kind::Assign:
+        case Kind::AssignDeclare: {
+            Symbol var_name = child(0).get_var();
+            if (var_name.str().rfind("this", 0) == 0) {
+                (*vt)[var_name] = sym::Bottom;
             }
+            return;
+        }
+        case Kind::Program:
+        case Kind::Classes:
+        case Kind::Class:
+        case Kind::Methods:
+        case Kind::Method:
+        case Kind::Formals:
+        case Kind::Formal:
+        case Kind::Block:
+        case Kind::Actuals:
+        case Kind::Type_Alternatives:
+        case Kind::Type_Alternative:
+        case Kind::Load:
+        case Kind::Dot:
+        case Kind::Ident:
+            return;
+        default:
+            report::out() << "UNIMPLEMENTED COLLECT_VARS" << endl;
         }
-        return methodname; 
     }
 
-    string If::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info) {
-        //cout << "ENTERING If::type_infer" << endl;
-        string cond_type = cond_.type_infer(ssc, vt, info);
-        if (cond_type != "Boolean") {
-            cout << "TypeError (If): Condition does not evaluate to type Boolean (ignoring statements)" << endl;
+    Symbol ASTNode::get_var() const {
+        // A Dot chain a.b.c nests to the left: walk down to a, then
+        // build the name back up, a then a.b then a.b.c
+        vector<ASTNode> fields;
+        ASTNode base = *this;
+        while (base.kind() == Kind::Load || base.kind() == Kind::Dot) {
+            if (base.kind() == Kind::Dot) { fields.push_back(base.child(1)); }
+            base = base.child(0);
+        }
+        Symbol var;
+        switch (base.kind()) {
+        case Kind::Ident:
+            var = base.text();
+            break;
+        case Kind::Program:
+        case Kind::Classes:
+        case Kind::Class:
+        case Kind::Methods:
+        case Kind::Method:
+        case Kind::Formals:
+        case Kind::Formal:
+        case Kind::Block:
+        case Kind::Actuals:
+        case Kind::Type_Alternatives:
+        case Kind::Type_Alternative:
+            var = sym::empty;
+            break;
+        default:
+            report::out() << "UNIMPLEMENTED GET_VAR" << endl;
+            var = sym::empty;
         }
-        truepart_.type_infer(ssc, vt, info);
-        falsepart_.type_infer(ssc, vt, info);
-        return "Nothing";
+        for (size_t i = fields.size(); i > 0; --i) {
+            var = var + "." + fields[i - 1].get_var();
+        }
+        return var;
     }
 
-    string Call::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info) {
-        string receivertype = receiver_.type_infer(ssc, vt, info);
-        string methodname = method_.get_var();
-        method_.type_infer(ssc, vt, info); // this does nothing
-        actuals_.type_infer(ssc, vt, info);
-        // is this method in the type of the receiver?
-        map<string, TypeNode> hierarchy = ssc->hierarchy;
-        TypeNode recvnode = hierarchy[receivertype];
-        map<string, MethodTable> methods = recvnode.methods;
-        if (!methods.count(methodname)) {
-            // can't find method in own class' method table!!
-            // let's search the parent(s)
-            while (1) {
-                string classname = recvnode.parent;
-                TypeNode parentnode = hierarchy[classname];
-                methods = parentnode.methods;
-                if (methods.count(methodname)) {break;} // we found it!
-                if (classname == "Obj") {
-                    cout << "Error (Call): method " << methodname << " is not defined for type " << receivertype << endl;
-                    return "Call:TypeError";
+    /* Definite initialization: every variable is assigned before it is
+     * used.  The first use of an uninitialized variable ends the check.
+     *
+     * Each name the program mentions has a number (see ASTNode::initcheck),
+     * and the initialized names are one bit vector.  Every name that
+     * becomes initialized goes on a trail, so a branch is whatever the
+     * trail gained while it was checked: entering one is remembering
+     * where the trail was, and leaving it is taking back what it added.
+     * An if keeps what both of its branches added, which touches only
+     * the names either of them initialized.
+     */
+    class InitCheck {
+        struct Frame {
+            ASTNode node;
+            int step = 0;
+            uint32_t trail = 0;             // If, While: where the trail was before the branch
+            uint32_t saved = 0;             // If: where saved_ was before the false branch
+            uint32_t serial = 0;            // If: marks what its true branch added
+            Frame(ASTNode node) : node{node} {}
+        };
+        Walk<Frame> walk_;
+        bool failed_ = false;
+        const NodeAnalysis<uint32_t>& numbers_;   // Of Ident and Dot nodes
+        vector<uint64_t> init_;
+        vector<uint32_t> trail_;                 // Names initialized since the start, in order
+        vector<uint32_t> mark_;                  // By name: serial of the if whose true branch added it, or 0
+        vector<pair<uint32_t, uint32_t>> saved_; // Names marked, and what their marks were before
+        uint32_t ifs_ = 0;
+
+        bool has(uint32_t bit) const { return (init_[bit / 64] >> (bit % 64)) & 1; }
+        void clear(uint32_t bit) { init_[bit / 64] &= ~(uint64_t(1) << (bit % 64)); }
+        bool has(ASTNode var) const { return has(numbers_.get(var.id())); }
+        void add(ASTNode var) {
+            uint32_t bit = numbers_.get(var.id());
+            if (has(bit)) { return; }
+            init_[bit / 64] |= uint64_t(1) << (bit % 64);
+            trail_.push_back(bit);
+        }
+
+        void call(Frame& f, int next, ASTNode node) {
+            f.step = next;
+            walk_.push(node);
+        }
+        void done() { walk_.pop(); }
+        void fail() { failed_ = true; }
+        void resume(Frame& f);
+    public:
+        /* Names are numbered below names; initialized has the bits of
+         * those that are initialized from the start */
+        InitCheck(const NodeAnalysis<uint32_t>& numbers, size_t names, const vector<uint64_t>& initialized)
+            : numbers_(numbers), init_(initialized), mark_(names, 0) {}
+
+        /* Check node, adding to what is initialized; 1 if it uses a variable before it is initialized */
+        int run(ASTNode node) {
+            walk_.push(node);
+            while (!walk_.empty() && !failed_) { resume(walk_.top()); }
+            return failed_ ? 1 : 0;  // 1 indicates failure
+        }
+    };
+
+    void InitCheck::resume(Frame& f) {
+        ASTNode n = f.node;
+        switch (n.kind()) {
+        case Kind::Classes:
+        case Kind::Methods:
+        case Kind::Formals:
+        case Kind::Block:
+        case Kind::Actuals:
+        case Kind::Type_Alternatives:
+        case Kind::Return:
+        case Kind::Not:
+        case Kind::Construct:
+        case Kind::Call:
+        case Kind::And:
+        case Kind::Or:
+            // every part, in order
+            if (static_cast<uint32_t>(f.step) < n.size()) { return call(f, f.step + 1, n[f.step]); }
+            return done();
+        case Kind::Ident:
+            if (!has(n)) {
+                report::semantic_error() << "INIT ERROR: var " << n.text() << " used before initialized" << endl;
+                return fail();
+            }
+            return done();
+        case Kind::Dot:
+            if (!has(n)) {
+                report::semantic_error() << "INIT ERROR: var " << n.get_var() << " used before initialized" << endl;
+                return fail();
+            }
+            return done();
+        case Kind::Formal:
+            add(n.child(0));
+            return done();
+        case Kind::Method:
+            if (f.step == 0) { return call(f, 1, n[1]); }
+            if (f.step == 1) { return call(f, 2, n[3]); }
+            return done(); // success
+        case Kind::Class:
+            if (f.step == 0) { return call(f, 1, n[2]); }
+            if (f.step == 1) { return call(f, 2, n[3]); }
+            return done();
+        case Kind::Assign:
+        case Kind::AssignDeclare:
+            if (f.step == 0) { return call(f, 1, n[1]); }
+            add(n.child(0));
+            return done();
+        case Kind::If:
+            if (f.step == 0) { return call(f, 1, n[0]); }
+            if (f.step == 1) {
+                f.trail = trail_.size();
+                return call(f, 2, n[1]);
+            }
+            if (f.step == 2) {
+                // mark what the true branch added and take it back
+                f.saved = saved_.size();
+                f.serial = ++ifs_;
+                for (size_t i = f.trail; i < trail_.size(); ++i) {
+                    uint32_t bit = trail_[i];
+                    saved_.push_back(make_pair(bit, mark_[bit]));
+                    mark_[bit] = f.serial;
+                    clear(bit);
+                }
+                trail_.resize(f.trail);
+                return call(f, 3, n[2]);
+            }
+            {
+                // keep what the false branch added only if the true branch added it too
+                size_t kept = f.trail;
+                for (size_t i = f.trail; i < trail_.size(); ++i) {
+                    uint32_t bit = trail_[i];
+                    if (mark_[bit] == f.serial) { trail_[kept++] = bit; }
+                    else { clear(bit); }
                 }
+                trail_.resize(kept);
+                while (saved_.size() > f.saved) {
+                    mark_[saved_.back().first] = saved_.back().second;
+                    saved_.pop_back();
+                }
+            }
+            return done();
+        case Kind::While:
+            // The body may not run, so nothing it initializes counts after
+            // the loop.  A second trip through it would start from what
+            // the first initialized, a superset of where the first started,
+            // so checking it once reaches the fixpoint.
+            if (f.step == 0) { return call(f, 1, n[0]); }
+            if (f.step == 1) {
+                f.trail = trail_.size();
+                return call(f, 2, n[1]);
             }
+            for (size_t i = f.trail; i < trail_.size(); ++i) { clear(trail_[i]); }
+            trail_.resize(f.trail);
+            return done();
+        case Kind::Load:
+        case Kind::IntConst:
+        case Kind::StrConst:
+            return done();
+        default:
+            report::out() << "UNIMPLEMENTED initcheck" << endl;
+            return done();
         }
-        MethodTable methodtable = methods[methodname];
-        if (methodtable.formalargtypes.size() != actuals_.elements_.size()) {
-            cout << "Error (Call): number of actual args (" << actuals_.elements_.size()
-                            << ") does not match method signature (" << methodtable.formalargtypes.size() 
-                            << ") for call: " << receiver_.get_var() << "." << methodname << "(...)" << endl;
-            return "Call:TypeError";
+    }
+
+    int ASTNode::initcheck(StaticSemantics* ssc) const {
+        // Number each name once: the classes and their methods, which
+        // are initialized from the start, then every variable and field
+        // the program mentions.  Checking flows through the classes and
+        // then the main program in order, so (for one) the fields a
+        // constructor initializes are initialized in its methods.
+        NodeAnalysis<uint32_t>& numbers = ssc->var_numbers;
+        unordered_map<Symbol, uint32_t> number;
+        for (map<Symbol, TypeNode>::iterator iter = ssc->hierarchy.begin(); iter != ssc->hierarchy.end(); ++iter) {
+            number.emplace(iter->first, number.size()); // class name as constructor
+            const map<Symbol, MethodTable>& methods = iter->second.methods;
+            for (map<Symbol, MethodTable>::const_iterator meth = methods.begin(); meth != methods.end(); ++meth) {
+                number.emplace(meth->first, number.size()); // method name
+            }
         }
-        for (int i = 0; i < actuals_.elements_.size(); i++) {
-            string formaltype = methodtable.formalargtypes[i];
-            string actualtype = actuals_.elements_[i]->type_infer(ssc, vt, info);
-            if (!ssc->is_subtype(actualtype, formaltype)) {
-                cout << "Error (Call): actual args do not conform to method signature for call: " << 
-                                        receiver_.get_var() << "." << methodname << "(...)" << endl;
-                return "Call:TypeError";
+        size_t predefined = number.size();
+        Tree* tree = tree_;
+        numbers.reserve(tree->nodes());
+        for (Node n = 0; n < tree->nodes(); ++n) {
+            Kind kind = tree->kind(n);
+            if (kind == Kind::Ident || kind == Kind::Dot) {
+                Symbol name = kind == Kind::Ident ? Symbol::from_id(tree->value(n)) : ssc->var_name(ASTNode(tree, n));
+                numbers.set(n, number.emplace(name, number.size()).first->second);
             }
         }
-        return methodtable.returntype;    
+        vector<uint64_t> initialized((number.size() + 63) / 64, 0);
+        for (size_t bit = 0; bit < predefined; ++bit) {
+            initialized[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+        InitCheck check(numbers, number.size(), initialized);
+        if (check.run(child(0))) {return 1;}
+        if (check.run(child(1))) {return 1;}
+        return 0;
     }
 
-    string AssignDeclare::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info)  {
-        //cout << "ENTERING: AssignDeclare::type_infer" << endl;
-        lexpr_.type_infer(ssc, vt, info);
-        string rhs_type = rexpr_.type_infer(ssc, vt, info);
-        string lhs_var = lexpr_.get_var();
-        string static_type = static_type_.get_var();
-        map<string, string> instancevars = (ssc->hierarchy)[info->classname].instance_vars;
-        if (!vt->count(lhs_var)) { // NOT in my table
-            if (instancevars.count(lhs_var)) { // in class instance vars
-                (*vt)[lhs_var] = instancevars[lhs_var]; // initialize in my table with other type
-            }
-            else { // NOT in class instance vars either
-                (*vt)[lhs_var] = static_type; // gets whatever rhs type is
-                ssc->changed = 1; // and something changed
-            } // end else
-        }
-        // if we've made it this far, we can perform LCA on the variable, which is in the table and initialized
-        string lhs_type = (*vt)[lhs_var];
-        string lca = ssc->get_LCA(lhs_type, rhs_type);
-        if (lhs_type != lca) { // change made only if we assign a new type to this var
-            if (!(ssc->is_subtype(lca, static_type))) {
-                (*vt)[lhs_var] = "TypeError";
-                cout << "TypeError (AssignDeclare): RHS type " << lca << " is not subtype of static type " << static_type << endl;
-            }
-            (*vt)[lhs_var] = lca;
-            ssc->changed = 1;
-        }
-        return "Nothing";
-    }
+    /* Type inference of a constructor, a method or the main program's
+     * statements (see StaticSemantics::typeCheck), or of an expression.
+     * Each frame holds the variable table and the class and method of
+     * the code it is in; a keeps a type across the inference of its
+     * children, whose type arrives in result_.
+     */
+    class TypeInfer {
+        struct Frame {
+            ASTNode node;
+            int step = 0;
+            uint32_t i = 0;                    // Next element of a sequence, or next actual argument
+            VarEnv* vt;
+            class_and_method* info;
+            Symbol a;
+            Frame(ASTNode node, VarEnv* vt, class_and_method* info)
+                : node{node}, vt{vt}, info{info} {}
+        };
+        Walk<Frame> walk_;
+        Symbol result_;
+        StaticSemantics* ssc;
+        NodeAnalysis<Symbol>* types_;            // Where each node's type is recorded, if anywhere
+        vector<Symbol> actual_types_;            // Call, Construct: the actual arguments' types, innermost call's last
 
-    string Assign::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info)  {
-        //cout << "ENTERING: Assign::type_infer" << endl;
-        lexpr_.type_infer(ssc, vt, info);
-        string rhs_type = rexpr_.type_infer(ssc, vt, info);
-        string lhs_var = lexpr_.get_var();
-        map<string, string> instancevars = (ssc->hierarchy)[info->classname].instance_vars;
-        if (!vt->count(lhs_var)) { // NOT in my table
-            if (instancevars.count(lhs_var)) { // in class instance vars
-                (*vt)[lhs_var] = instancevars[lhs_var]; // initialize in my table with other type
-            }
-            else { // NOT in class instance vars either
-                (*vt)[lhs_var] = rhs_type; // gets whatever rhs type is
-                ssc->changed = 1; // and something changed
-            } // end else
-        }
-        // if we've made it this far, we can perform LCA on the variable, which is in the table and initialized
-        string lhs_type = (*vt)[lhs_var];
-        string lca = ssc->get_LCA(lhs_type, rhs_type);
-        if (lhs_type != lca) { // change made only if we assign a new type to this var
-            (*vt)[lhs_var] = lca;
-            ssc->changed = 1;
-        }
-        return "Nothing";
-    }
+        /* The types of the count actuals of a call or construct, inferred
+         * once each and left at the end of actual_types_ */
+        const Symbol* actual_types(size_t count) const { return actual_types_.data() + actual_types_.size() - count; }
 
-    string Methods::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info) {
-        //cout << "ENTERING: Methods::type_infer" << endl;
-        for (Method* method: elements_) {
-            string methodname = method->name_.get_var();
-            TypeNode classentry = ssc->hierarchy[info->classname];
-            MethodTable methodtable = classentry.methods[methodname];
-            map<string, string>* methodvars = methodtable.vars;
-            class_and_method* methodinfo = new class_and_method(info->classname, methodname);
-            method->type_infer(ssc, methodvars, methodinfo);
-            // Before we remove them, are the class instance vars being assigned conformant types?
-            map<string, string> classinstance = classentry.instance_vars;
-            for(map<string, string>::iterator iter = methodvars->begin(); iter != methodvars->end(); ++iter) {
-                if (classinstance.count(iter->first)) { // if this var is in the class instance table
-                    string methodtype = iter->second;
-                    string classtype = classinstance[iter->first];
-                    if (!ssc->is_subtype(methodtype, classtype)) {
-                        cout << "Error (Methods): instance variable " << iter->first << " assigned non-conformant"
-                                        << " type in method " << methodname << ". Instance type: " << classtype
-                                        << ", Method assigned type: " << methodtype << endl;
-                    }
+        /* What receiver.methodname(actuals) returns, once receiver has type
+         * receivertype, if there is such a method and the actuals fit it */
+        Symbol call_type(Symbol receivertype, ASTNode receiver, Symbol methodname, size_t count) {
+            // is this method in the type of the receiver (its vtable has the inherited ones too)?
+            const MethodTable* method = ssc->find_method(receivertype, methodname);
+            if (method == nullptr) {
+                report::semantic_error() << "Error (Call): method " << methodname << " is not defined for type " << receivertype << endl;
+                return "Call:TypeError";
+            }
+            const MethodTable& methodtable = *method;
+            if (methodtable.formalargtypes.size() != count) {
+                report::semantic_error() << "Error (Call): number of actual args (" << count
+                                << ") does not match method signature (" << methodtable.formalargtypes.size()
+                                << ") for call: " << receiver.get_var() << "." << methodname << "(...)" << endl;
+                return "Call:TypeError";
+            }
+            const Symbol* actuals = actual_types(count);
+            for (size_t i = 0; i < count; ++i) {
+                if (!ssc->is_subtype(actuals[i], methodtable.formalargtypes[i])) {
+                    report::semantic_error() << "Error (Call): actual args do not conform to method signature for call: " <<
+                                            receiver.get_var() << "." << methodname << "(...)" << endl;
+                    return "Call:TypeError";
                 }
             }
+            return methodtable.returntype;
         }
-        return "Nothing";
-    }
 
-    string Classes::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info) {
-        for (AST::Class *cls: elements_) {
-            class_and_method* info = new class_and_method(cls->name_.get_var(), "");
-            cls->type_infer(ssc, vt, info);
-        }
-        // CHECK WHETHER SUBCLASSES HAVE ALL SUPERCLASS INSTANCE VARIABLES
-        // TODO: do we need to do this AFTER everything has been populated? probably
-        map<string, TypeNode> hierarchy = ssc->hierarchy;
-        for (AST::Class *cls: elements_) {
-            string classname  = cls->name_.get_var();
-            TypeNode classnode = hierarchy[classname];
-            string parentname = classnode.parent;
-            TypeNode parentnode = hierarchy[parentname];
-            map<string, string> class_iv = classnode.instance_vars;
-            map<string, string> parent_iv = parentnode.instance_vars;
-            for(map<string, string>::iterator iter = parent_iv.begin(); iter != parent_iv.end(); ++iter) {
-                string var_name = iter->first;
-                if (!class_iv.count(var_name)) {
-                    cout << "Error: class " << classname << " missing parent instance var " << var_name << endl;
+        /* The class a Construct makes, if its actuals fit the constructor */
+        Symbol construct_type(Symbol classname, size_t count) {
+            // verify that the construct call matches signature
+            const TypeNode* classnode = ssc->find_class(classname); // method name same as class name
+            size_t formals = classnode ? classnode->construct.formalargtypes.size() : 0;
+            if (formals != count) {
+                report::semantic_error() << "Error (Construct): number of actual args (" << count
+                                << ") does not match method signature (" << formals
+                                << ") for call: " << classname << "(...)" << endl;
+                return "Construct:TypeError";
+            }
+            const Symbol* actuals = actual_types(count);
+            for (size_t i = 0; i < count; ++i) {
+                if (!ssc->is_subtype(actuals[i], classnode->construct.formalargtypes[i])) {
+                    report::semantic_error() << "Error (Construct): actual args do not match method signature for constructor call: "
+                                            << classname << "(...)" << endl;
+                    return "Construct:TypeError";
                 }
             }
+            return classname;
         }
-        return "Nothing";
-    }
 
-    string Class::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info) {
-            int returnval = 0;
-            //cout << "ENTERING Class::type_infer" << endl;
-            map<string, string>* classinstancevars = &(ssc->hierarchy[info->classname].instance_vars);
-            TypeNode * classnode = &ssc->hierarchy[info->classname];
-            MethodTable * constructor = &classnode->construct;
-            map<string, string>* construct_instvars = constructor->vars;
-            constructor_.type_infer(ssc, construct_instvars, info);
-
-            // update class-level instance vars
-            for(map<string, string>::iterator iter = classinstancevars->begin(); iter != classinstancevars->end(); ++iter) {
-                if (iter->first.rfind("this", 0) == 0) {
-                    (*classinstancevars)[iter->first] = (*construct_instvars)[iter->first];
-                    vector<string> splitthis = ssc->split(iter->first, '.');
-                    if (splitthis.size() == 2) {
-                        (*classinstancevars)[splitthis[1]] = (*construct_instvars)[iter->first];
-                    }
-                }   
-            }
-            (*classinstancevars)["this"] = info->classname; // put a this in there!
-            (*construct_instvars)["this"] = info->classname;
-
-            info = new class_and_method(name_.get_var(), "");
-            methods_.type_infer(ssc, vt, info);
-            return "Nothing";
+        void call(Frame& f, int next, ASTNode node, VarEnv* vt, class_and_method* info) {
+            f.step = next;
+            enter(node, vt, info);
+        }
+        void enter(ASTNode node, VarEnv* vt, class_and_method* info) {
+            walk_.push(node, vt, info);
+        }
+        void done(Symbol type) {
+            Frame& f = walk_.top();
+            if (types_) { types_->set(f.node.id(), type); }
+            result_ = type;
+            walk_.pop();
+        }
+        void resume(Frame& f);
+    public:
+        TypeInfer(StaticSemantics* ssc, NodeAnalysis<Symbol>* types) : ssc{ssc}, types_{types} {}
+        Symbol run(ASTNode node, VarEnv* vt, class_and_method* info) {
+            enter(node, vt, info);
+            while (!walk_.empty()) { resume(walk_.top()); }
+            return result_;
+        }
+    };
+
+    void TypeInfer::resume(Frame& f) {
+        ASTNode n = f.node;
+        VarEnv* vt = f.vt;
+        class_and_method* info = f.info;
+        switch (n.kind()) {
+        case Kind::Block:
+            if (f.i < n.size()) {
+                ++ssc->effects().statement_visits;
+                return call(f, 1, n[f.i++], vt, info);
+            }
+            return done(sym::Nothing);
+        case Kind::Formals:
+        case Kind::Actuals:
+        case Kind::Type_Alternatives:
+            if (f.i < n.size()) { return call(f, 1, n[f.i++], vt, info); }
+            return done(sym::Nothing);
+        case Kind::Method:
+            //report::out() << "ENTERING Method::type_infer for method " << n.child(0).get_var() << endl;
+            if (f.step == 0) { return call(f, 1, n[1], vt, info); }
+            if (f.step == 1) { return call(f, 2, n[3], vt, info); }
+            return done(sym::Nothing);
+        case Kind::Formal: {
+            Symbol var = n.child(0).get_var();
+            Symbol type = n.child(1).get_var();
+            vt->set(var, type);
+            return done(type);
+        }
+        case Kind::Assign:
+        case Kind::AssignDeclare: {
+            if (f.step == 0) { return call(f, 1, n[0], vt, info); }
+            if (f.step == 1) { return call(f, 2, n[1], vt, info); }
+            Symbol rhs_type = result_;
+            Symbol lhs_var = ssc->var_name(n.child(0));
+            bool declared = n.kind() == Kind::AssignDeclare;
+            Symbol static_type = declared ? n.child(2).get_var() : sym::empty;
+            const map<Symbol, Symbol>& instancevars = ssc->find_class(info->classname)->instance_vars;
+            if (!vt->count(lhs_var)) { // NOT in my table
+                if (instancevars.count(lhs_var)) { // in class instance vars
+                    vt->set(lhs_var, instancevars.at(lhs_var)); // initialize in my table with other type
+                }
+                else { // NOT in class instance vars either
+                    vt->set(lhs_var, declared ? static_type : rhs_type); // gets the declared or the rhs type
+                    ssc->effects().changed = 1; // and something changed
+                } // end else
+            }
+            // if we've made it this far, we can perform LCA on the variable, which is in the table and initialized
+            Symbol lhs_type = vt->get(lhs_var);
+            Symbol lca = ssc->get_LCA(lhs_type, rhs_type);
+            if (lhs_type != lca) { // change made only if we assign a new type to this var
+                if (declared && !(ssc->is_subtype(lca, static_type))) {
+                    vt->set(lhs_var, sym::TypeError);
+                    report::semantic_error() << "TypeError (AssignDeclare): RHS type " << lca << " is not subtype of static type " << static_type << endl;
+                }
+                vt->set(lhs_var, lca);
+                ssc->effects().changed = 1;
+            }
+            return done(sym::Nothing);
+        }
+        case Kind::Return: {
+            //report::out() << "ENTERING Return::type_infer" << endl;
+            if (f.step == 0) {
+                const MethodTable* method = ssc->find_method(info->classname, info->methodname);
+                f.a = method ? method->returntype : Symbol();
+                return call(f, 1, n[0], vt, info);
+            }
+            Symbol methodreturntype = f.a;
+            Symbol thisreturntype = result_;
+            if (!ssc->is_subtype(thisreturntype, methodreturntype)) {
+                report::semantic_error() << "TypeError (Return): type of return expr " << thisreturntype << " is not subtype of method return type " << methodreturntype << endl;
+            }
+            return done(sym::Nothing);
+        }
+        case Kind::If: {
+            //report::out() << "ENTERING If::type_infer" << endl;
+            if (f.step == 0) { return call(f, 1, n[0], vt, info); }
+            if (f.step == 1) {
+                Symbol cond_type = result_;
+                if (cond_type != sym::Boolean) {
+                    report::semantic_error() << "TypeError (If): Condition does not evaluate to type Boolean (ignoring statements)" << endl;
+                }
+                return call(f, 2, n[1], vt, info);
+            }
+            if (f.step == 2) { return call(f, 3, n[2], vt, info); }
+            return done(sym::Nothing);
+        }
+        case Kind::While: {
+            //report::out() << "ENTERING While::type_infer" << endl;
+            if (f.step == 0) { return call(f, 1, n[0], vt, info); }
+            if (f.step == 1) {
+                Symbol cond_type = result_;
+                if (cond_type != sym::Boolean) {
+                    report::semantic_error() << "TypeError (While): Condition does not evaluate to type Boolean (ignoring statements)" << endl;
+                }
+                return call(f, 2, n[1], vt, info);
+            }
+            return done(sym::Nothing);
+        }
+        case Kind::Typecase:
+            if (f.step == 0) { return call(f, 1, n[0], vt, info); }
+            if (f.step == 1) { return call(f, 2, n[1], vt, info); }
+            return done(sym::Nothing);
+        case Kind::Type_Alternative: {
+            ASTNode ident = n.child(0);
+            ASTNode classname = n.child(1);
+            if (f.step == 0) { return call(f, 1, ident, vt, info); }
+            if (f.step == 1) { return call(f, 2, classname, vt, info); }
+            if (f.step == 2) {
+                // The arm's statements see the identifier bound, and what they set is undone after
+                vt->push_scope();
+                vt->set(ident.get_var(), classname.get_var());
+                return call(f, 3, n[2], vt, info);
+            }
+            // TODO: do we need to put any changes to the local vars here into the original vt?? to make sure we start
+            // where we left off next iteration?
+            vt->pop_scope();
+            return done(sym::Nothing);
+        }
+        case Kind::Load:
+            if (f.step == 0) { return call(f, 1, n[0], vt, info); }
+            return done(result_);
+        case Kind::Ident: {
+            Symbol text_ = n.text();
+            if (text_ == sym::this_) {
+                const map<Symbol, Symbol>& instancevars = ssc->find_class(info->classname)->instance_vars;
+                if (instancevars.count(text_)) {return done(instancevars.at(text_));}
+                else { return done("TypeErrorthissss");}
+            }
+            int slot = vt->slot(text_);
+            if (slot >= 0) { // Identifier in table
+                return done(vt->type(slot));
+            }
+            else { // not in table!!
+                report::out() << "TypeError: Identifier " << text_ << " uninitialized" << endl;
+                return done(sym::TypeError); // error??
+            }
+        }
+        case Kind::Dot: {
+            ASTNode left = n.child(0);
+            ASTNode right = n.child(1);
+            // The field's name is not a variable: only the object is inferred
+            if (f.step == 0) { return call(f, 1, left, vt, info); }
+            Symbol lhs_type = result_;
+            ssc->reads_instance_vars(lhs_type);
+            Symbol type = ssc->resolve_field(n, lhs_type, right.text());
+            return done(type.empty() ? Symbol("Dot:TypeError") : type);
+        }
+        case Kind::IntConst:
+            return done(sym::Int);
+        case Kind::StrConst:
+            return done(sym::String);
+        case Kind::Construct: {
+            //report::out() << "ENTERING Construct::type_infer" << endl;
+            ASTNode actuals = n.child(1);
+            // type-check actual args
+            if (f.step == 1) { actual_types_.push_back(result_); }
+            if (f.i < actuals.size()) { return call(f, 1, actuals[f.i++], vt, info); }
+            Symbol type = construct_type(n.child(0).get_var(), actuals.size());
+            actual_types_.resize(actual_types_.size() - actuals.size());
+            return done(type);
+        }
+        case Kind::Call: {
+            // a: the receiver's type; the actuals' types go on actual_types_
+            ASTNode receiver = n.child(0);
+            ASTNode method = n.child(1);
+            ASTNode actuals = n.child(2);
+            Symbol methodname = method.get_var();
+            if (f.step == 0) {
+                ++ssc->effects().call_infers;
+                return call(f, 1, receiver, vt, info);
+            }
+            if (f.step == 1) { f.a = result_; }  // the method's name is not a variable: it is not inferred
+            if (f.step == 3) { actual_types_.push_back(result_); }
+            if (f.i < actuals.size()) { return call(f, 3, actuals[f.i++], vt, info); }
+            Symbol type = call_type(f.a, receiver, methodname, actuals.size());
+            actual_types_.resize(actual_types_.size() - actuals.size());
+            return done(type);
+        }
+        case Kind::And:
+        case Kind::Or: {
+            // Binary operations on Booleans: both sides must be Boolean
+            if (f.step == 0) { return call(f, 1, n[0], vt, info); }
+            if (f.step == 1) {
+                f.a = result_;
+                return call(f, 2, n[1], vt, info);
+            }
+            Symbol left_type = f.a;
+            Symbol right_type = result_;
+            if (left_type != sym::Boolean || right_type != sym::Boolean) {
+                return done(n.kind() == Kind::And ? "And:TypeError" : "Or:TypeError");
+            }
+            return done(sym::Boolean);
+        }
+        case Kind::Not: {
+            if (f.step == 0) { return call(f, 1, n[0], vt, info); }
+            Symbol left_type = result_;
+            if (left_type != sym::Boolean) {return done("Not:TypeError");}
+            return done(sym::Boolean);
+        }
+        case Kind::Stub:
+            report::out() << "UNIMP TYPEINFER STUB" << endl;
+            return done(sym::empty);
+        case Kind::Program:
+        case Kind::Classes:
+        case Kind::Class:
+        case Kind::Methods:
+            // Checking infers types a method at a time, never from above one
+            break;
+        }
+        report::out() << "UNIMPLEMENTED type_infer" << endl;
+        return done("UNIMP type_infer");
     }
 
-    string Return::type_infer(StaticSemantics* ssc, map<string, string>* vt, class_and_method* info) {
-        //cout << "ENTERING Return::type_infer" << endl;
-        string methodname = info->methodname;
-        TypeNode classnode = ssc->hierarchy[info->classname];
-        MethodTable methodtable = classnode.methods[methodname];
-        string methodreturntype = methodtable.returntype;
-        string thisreturntype = expr_.type_infer(ssc, vt, info);
-        if (!ssc->is_subtype(thisreturntype, methodreturntype)) {
-            cout << "TypeError (Return): type of return expr " << thisreturntype << " is not subtype of method return type " << methodreturntype << endl;
-        }
-        return "Nothing";
+    Symbol ASTNode::type_infer(StaticSemantics* ssc, VarEnv* vt, class_and_method* info,
+                               NodeAnalysis<Symbol>* types) const {
+        TypeInfer infer(ssc, types);
+        return infer.run(*this, vt, info);
     }
 
     // JSON representation of all the concrete node types.
@@ -332,10 +925,62 @@ namespace AST {
     // tree manipulation in Python or another language.  We'll
     // do this by emitting into a stream.
 
-    // --- Utility functions used by node-specific json output methods
+    const char* kind_name(Kind kind) {
+        static const char* const names[] = {
+            "Program", "Classes", "Class", "Methods", "Method", "Formals", "Formal", "Block",
+            "Assign", "Assign", "Return", "If", "While", "Typecase", "Type_Alternatives",
+            "Type_Alternative", "Load", "Dot", "Call", "Actuals", "Construct", "And", "Or", "Not",
+            "Ident", "IntConst", "StrConst", "Stub"
+        };
+        return names[static_cast<int>(kind)];
+    }
+
+    /* Field names of the children, for the kinds with a fixed number of them */
+    static const char* const* json_fields(Kind kind) {
+        static const char* const program[] = {"classes_", "statements_"};
+        static const char* const cls[] = {"name_", "super_", "constructor_", "methods_"};
+        static const char* const method[] = {"name_", "formals_", "returns_", "statements_"};
+        static const char* const formal[] = {"var_", "type_"};
+        static const char* const assign[] = {"lexpr_", "rexpr_", "static_type_"};
+        static const char* const ret[] = {"expr_"};
+        static const char* const ifelse[] = {"cond_", "truepart_", "falsepart_"};
+        static const char* const loop[] = {"cond_", "body_"};
+        static const char* const typecase[] = {"expr_", "cases_"};
+        static const char* const alternative[] = {"ident_", "classname_", "block_"};
+        static const char* const load[] = {"loc_"};
+        static const char* const binary[] = {"left_", "right_"};
+        static const char* const call[] = {"obj_", "method_", "actuals_"};
+        static const char* const construct[] = {"method_", "actuals_"};
+        switch (kind) {
+        case Kind::Program: return program;
+        case Kind::Class: return cls;
+        case Kind::Method: return method;
+        case Kind::Formal: return formal;
+        case Kind::Assign:
+        case Kind::AssignDeclare: return assign;
+        case Kind::Return: return ret;
+        case Kind::If: return ifelse;
+        case Kind::While: return loop;
+        case Kind::Typecase: return typecase;
+        case Kind::Type_Alternative: return alternative;
+        case Kind::Load: return load;
+        case Kind::Dot:
+        case Kind::And:
+        case Kind::Or:
+        case Kind::Not: return binary;
+        case Kind::Call: return call;
+        case Kind::Construct: return construct;
+        default: return nullptr;
+        }
+    }
+
+    // --- Utility functions used by the json output
 
     /* Indent to a given level */
-    void ASTNode::json_indent(ostream& out, AST_print_context& ctx) {
+    static void json_indent(ostream& out, AST_print_context& ctx) {
+        if (ctx.indent_ > AST_print_context::MAX_INDENT) {
+            return;
+        }
         if (ctx.indent_ > 0) {
             out << endl;
         }
@@ -345,185 +990,66 @@ namespace AST {
     }
 
     /* The head element looks like { "kind" : "block", */
-    void ASTNode::json_head(string node_kind, ostream& out, AST_print_context& ctx) {
+    static void json_head(string node_kind, ostream& out, AST_print_context& ctx) {
         json_indent(out, ctx);
         out << "{ \"kind\" : \"" << node_kind << "\"," ;
         ctx.indent();  // one level more for children
         return;
     }
 
-    void ASTNode::json_close(ostream& out, AST_print_context& ctx) {
+    static void json_close(ostream& out, AST_print_context& ctx) {
         // json_indent(out, ctx);
         out << "}";
         ctx.dedent();
     }
 
-    void ASTNode::json_child(string field, ASTNode& child, ostream& out, AST_print_context& ctx, char sep) {
-        json_indent(out, ctx);
-        out << "\"" << field << "\" : ";
-        child.json(out, ctx);
-        out << sep;
-    }
-
-    void Stub::json(ostream& out, AST_print_context& ctx) {
-        json_head("Stub", out, ctx);
-        json_indent(out, ctx);
-        out  << "\"rule\": \"" <<  name_ << "\"";
-        json_close(out, ctx);
-    }
-
-
-    void Program::json(ostream &out, AST::AST_print_context &ctx) {
-        json_head("Program", out, ctx);
-        json_child("classes_", classes_, out, ctx);
-        json_child("statements_", statements_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void Formal::json(ostream &out, AST::AST_print_context &ctx) {
-        json_head("Formal", out, ctx);
-        json_child("var_", var_, out, ctx);
-        json_child("type_", type_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void Method::json(ostream &out, AST::AST_print_context &ctx) {
-        json_head("Method", out, ctx);
-        json_child("name_", name_, out, ctx);
-        json_child("formals_", formals_, out, ctx);
-        json_child("returns_", returns_, out, ctx);
-        json_child("statements_", statements_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void Assign::json(ostream& out, AST_print_context& ctx) {
-        json_head("Assign", out, ctx);
-        json_child("lexpr_", lexpr_, out, ctx);
-        json_child("rexpr_", rexpr_, out, ctx, ' ');
-        json_close(out, ctx);
-     }
-
-    void AssignDeclare::json(ostream& out, AST_print_context& ctx) {
-        json_head("Assign", out, ctx);
-        json_child("lexpr_", lexpr_, out, ctx);
-        json_child("rexpr_", rexpr_, out, ctx);
-        json_child("static_type_", static_type_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void Return::json(ostream &out, AST::AST_print_context &ctx) {
-        json_head("Return", out, ctx);
-        json_child("expr_", expr_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void If::json(ostream& out, AST_print_context& ctx) {
-        json_head("If", out, ctx);
-        json_child("cond_", cond_, out, ctx);
-        json_child("truepart_", truepart_, out, ctx);
-        json_child("falsepart_", falsepart_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void While::json(ostream& out, AST_print_context& ctx) {
-        json_head("While", out, ctx);
-        json_child("cond_", cond_, out, ctx);
-        json_child("body_", body_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-
-    void Typecase::json(ostream& out, AST_print_context& ctx) {
-        json_head("Typecase", out, ctx);
-        json_child("expr_", expr_, out, ctx);
-        json_child("cases_", cases_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void Type_Alternative::json(ostream& out, AST_print_context& ctx) {
-        json_head("Type_Alternative", out, ctx);
-        json_child("ident_", ident_, out, ctx);
-        json_child("classname_", classname_, out, ctx);
-        json_child("block_", block_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void Load::json(ostream &out, AST::AST_print_context &ctx) {
-        json_head("Load", out, ctx);
-        json_child("loc_", loc_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void Ident::json(ostream& out, AST_print_context& ctx) {
-        json_head("Ident", out, ctx);
-        out << "\"text_\" : \"" << text_ << "\"";
-        json_close(out, ctx);
-    }
-
-    void Class::json(ostream &out, AST::AST_print_context &ctx) {
-        json_head("Class", out, ctx);
-        json_child("name_", name_, out, ctx);
-        json_child("super_", super_, out, ctx);
-        json_child("constructor_", constructor_, out, ctx);
-        json_child("methods_", methods_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void Call::json(ostream &out, AST::AST_print_context &ctx) {
-        json_head("Call", out, ctx);
-        json_child("obj_", receiver_, out, ctx);
-        json_child("method_", method_, out, ctx);
-        json_child("actuals_", actuals_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void Construct::json(ostream &out, AST::AST_print_context &ctx) {
-        json_head("Construct", out, ctx);
-        json_child("method_", method_, out, ctx);
-        json_child("actuals_", actuals_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void IntConst::json(ostream& out, AST_print_context& ctx) {
-        json_head("IntConst", out, ctx);
-        out << "\"value_\" : " << value_ ;
-        json_close(out, ctx);
-    }
-
-    void StrConst::json(ostream& out, AST_print_context& ctx) {
-        json_head("StrConst", out, ctx);
-        out << "\"value_\" : \"" << value_  << "\"";
-        json_close(out, ctx);
-    }
-
-
-    void BinOp::json(ostream& out, AST_print_context& ctx) {
-        json_head(opsym, out, ctx);
-        json_child("left_", left_, out, ctx);
-        json_child("right_", right_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-
-    void Not::json(ostream& out, AST_print_context& ctx) {
-        json_head("Not", out, ctx);
-        json_child("left_", left_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-    void Dot::json(ostream& out, AST_print_context& ctx) {
-        json_head("Dot", out, ctx);
-        json_child("left_", left_, out, ctx);
-        json_child("right_", right_, out, ctx, ' ');
-        json_close(out, ctx);
-    }
-
-
-    /* Convenience factory for operations like +, -, *, / */
-    Call* Call::binop(string opname, Expr& receiver, Expr& arg) {
-        Ident* method = new Ident(opname);
-        Actuals* actuals = new Actuals();
-        actuals->append(&arg);
-        return new Call(receiver, *method, *actuals);
+    void ASTNode::json(ostream& out, AST_print_context& ctx) const {
+        // step 0 writes the head; step k writes child k-1, after the
+        // separator that follows child k-2
+        struct Frame {
+            ASTNode node;
+            uint32_t step;
+            Frame(ASTNode node) : node{node}, step{0} {}
+        };
+        Walk<Frame> walk;
+        walk.push(*this);
+        while (!walk.empty()) {
+            Frame& f = walk.top();
+            ASTNode n = f.node;
+            Kind kind = n.kind();
+            if (f.step == 0) {
+                json_head(kind_name(kind), out, ctx);
+                if (is_sequence(kind)) {
+                    out << "\"elements_\" : [";
+                } else if (kind == Kind::Ident) {
+                    out << "\"text_\" : \"" << n.text() << "\"";
+                } else if (kind == Kind::IntConst) {
+                    out << "\"value_\" : " << n.int_value();
+                } else if (kind == Kind::StrConst) {
+                    out << "\"value_\" : \"" << n.literal() << "\"";
+                } else if (kind == Kind::Stub) {
+                    json_indent(out, ctx);
+                    out  << "\"rule\": \"" << n.text() << "\"";
+                }
+            } else if (!is_sequence(kind)) {
+                out << (f.step < n.size() ? ',' : ' ');
+            }
+            if (f.step < n.size()) {
+                if (is_sequence(kind)) {
+                    if (f.step > 0) { out << ", "; }
+                } else {
+                    json_indent(out, ctx);
+                    out << "\"" << json_fields(kind)[f.step] << "\" : ";
+                }
+                ++f.step;
+                walk.push(n.child(f.step - 1));
+                continue;
+            }
+            if (is_sequence(kind)) {
+                out << "]";
+            }
+            json_close(out, ctx);
+            walk.pop();
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,146 @@
+//
+// Region allocator for a single compilation.
+//
+// Everything the compiler builds while processing one source file
+// (symbol tables, code generation contexts, translated string
+// literals) is carved out of the Driver's arena and released in one
+// shot when the Driver goes away.  The AST has arrays of its own
+// (AST::Tree), which the Driver also owns.  Allocation is a pointer bump; the
+// arena keeps a list of destructors for objects that own heap memory
+// of their own (strings, maps) and runs them on release.
+//
+
+#ifndef AST_ARENA_H
+#define AST_ARENA_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <new>
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+#include <ostream>
+#include <type_traits>
+
+using namespace std;
+
+class Arena {
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    vector<char*> blocks;
+    char* next = nullptr;     // First free byte in current block
+    char* limit = nullptr;    // End of current block
+
+    // Objects with non-trivial destructors, in allocation order
+    vector<pair<void*, void (*)(void*)>> finalizers;
+
+    // Bytes handed out, attributed to the phase that asked for them
+    vector<string> phase_order;
+    map<string, size_t> phase_bytes;
+    size_t* phase_counter = nullptr;   // Entry in phase_bytes for the current phase
+    size_t total_bytes = 0;
+
+    // Blocks come from operator new, so heap accounting (Memory.h) sees them
+    char* new_block(size_t size) {
+        char* block = static_cast<char*>(::operator new(size));
+        blocks.push_back(block);
+        return block;
+    }
+
+public:
+    Arena() { phase("init"); }
+    ~Arena() { release(); }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* alloc(size_t size, size_t align = alignof(max_align_t)) {
+        if (size == 0) { size = 1; }
+        size_t pad = (align - (reinterpret_cast<uintptr_t>(next) % align)) % align;
+        if (next == nullptr || pad + size > static_cast<size_t>(limit - next)) {
+            if (size + align > BLOCK_SIZE / 4) {
+                // Big requests get a block of their own, so the current
+                // block keeps serving small ones.
+                char* big = new_block(size + align);
+                pad = (align - (reinterpret_cast<uintptr_t>(big) % align)) % align;
+                *phase_counter += size;
+                total_bytes += size;
+                return big + pad;
+            }
+            next = new_block(BLOCK_SIZE);
+            limit = next + BLOCK_SIZE;
+            pad = (align - (reinterpret_cast<uintptr_t>(next) % align)) % align;
+        }
+        char* result = next + pad;
+        next = result + size;
+        *phase_counter += size;
+        total_bytes += size;
+        return result;
+    }
+
+    /* Construct a T in the arena.  Its destructor runs when the arena is released. */
+    template<class T, class... Args>
+    T* make(Args&&... args) {
+        T* obj = new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!is_trivially_destructible<T>::value) {
+            on_release(obj, [](void* p) { static_cast<T*>(p)->~T(); });
+        }
+        return obj;
+    }
+
+    /* NUL-terminated copy of len bytes of s */
+    char* strdup(const char* s, size_t len) {
+        char* copy = static_cast<char*>(alloc(len + 1, 1));
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+        return copy;
+    }
+    char* strdup(const char* s) { return strdup(s, strlen(s)); }
+
+    void on_release(void* obj, void (*fn)(void*)) { finalizers.push_back(make_pair(obj, fn)); }
+
+    /* Subsequent allocations are charged to the named phase */
+    void phase(const string& name) {
+        if (!phase_bytes.count(name)) {
+            phase_order.push_back(name);
+        }
+        phase_counter = &phase_bytes[name];
+    }
+
+    /* Names of the phases, in the order they began */
+    const vector<string>& phases() const { return phase_order; }
+
+    size_t bytes_used() const { return total_bytes; }
+    size_t bytes_used(const string& phase) const {
+        map<string, size_t>::const_iterator found = phase_bytes.find(phase);
+        return found == phase_bytes.end() ? 0 : found->second;
+    }
+
+    void report(ostream& out) const {
+        out << "Arena: " << total_bytes << " bytes in " << blocks.size() << " blocks" << endl;
+        for (const string& name: phase_order) {
+            out << "\t" << name << ": " << phase_bytes.at(name) << " bytes" << endl;
+        }
+    }
+
+    /* Destroy everything at once.  Destructors run newest first. */
+    void release() {
+        for (size_t i = finalizers.size(); i > 0; --i) {
+            finalizers[i - 1].second(finalizers[i - 1].first);
+        }
+        finalizers.clear();
+        for (char* block: blocks) { ::operator delete(block); }
+        blocks.clear();
+        next = limit = nullptr;
+    }
+
+    /* The arena serving the compilation in progress on this thread, if any */
+    static Arena*& current() {
+        static thread_local Arena* active = nullptr;
+        return active;
+    }
+};
+
+#endif //AST_ARENA_H
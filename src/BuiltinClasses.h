@@ -0,0 +1,80 @@
+//
+// The built-in classes of Quack, as the runtime (Builtins.h and
+// Builtins.c, at the top of the tree) implements them.
+//
+// Each class lists the method slots of its class_X_struct after the
+// constructor, in order, so the vtables the checker lays out for the
+// builtins (and for classes that extend them) are the runtime's.  The
+// table is constant data, compiled into the binary; the checker makes
+// its TypeNodes from it once per process (see StaticSemantics::builtins).
+// tests/builtins_table.py checks it against the runtime.
+//
+
+#ifndef AST_BUILTINCLASSES_H
+#define AST_BUILTINCLASSES_H
+
+#include <cstddef>
+
+namespace builtin {
+
+    struct Method {
+        const char* name;
+        const char* returns;
+        const char* formal;     // Type of the argument after the receiver; nullptr if there is none
+        const char* from;       // Class whose X_method_NAME fills the slot
+    };
+
+    struct Class {
+        const char* name;
+        const char* parent;
+        const Method* methods;  // By slot
+        size_t count;
+    };
+
+    constexpr Method obj_methods[] = {
+        {"STRING", "String", nullptr, "Obj"},
+        {"PRINT", "Obj", nullptr, "Obj"},
+        {"EQUALS", "Boolean", "Obj", "Obj"},
+    };
+
+    constexpr Method string_methods[] = {
+        {"STRING", "String", nullptr, "String"},
+        {"PRINT", "String", nullptr, "String"},
+        {"EQUALS", "Boolean", "Obj", "String"},
+        {"LESS", "Boolean", "String", "String"},
+        {"MORE", "Boolean", "String", "String"},
+    };
+
+    constexpr Method boolean_methods[] = {
+        {"STRING", "String", nullptr, "Boolean"},
+        {"PRINT", "Obj", nullptr, "Obj"},
+        {"EQUALS", "Boolean", "Obj", "Obj"},
+    };
+
+    constexpr Method nothing_methods[] = {
+        {"STRING", "String", nullptr, "Nothing"},
+        {"PRINT", "Obj", nullptr, "Obj"},
+        {"EQUALS", "Boolean", "Obj", "Obj"},
+    };
+
+    constexpr Method int_methods[] = {
+        {"STRING", "String", nullptr, "Int"},
+        {"PRINT", "Obj", nullptr, "Obj"},
+        {"EQUALS", "Boolean", "Obj", "Int"},
+        {"LESS", "Boolean", "Int", "Int"},
+        {"MORE", "Boolean", "Int", "Int"},
+        {"PLUS", "Int", "Int", "Int"},
+    };
+
+    // Parents before their children
+    constexpr Class classes[] = {
+        {"Obj", nullptr, obj_methods, sizeof(obj_methods) / sizeof(Method)},
+        {"String", "Obj", string_methods, sizeof(string_methods) / sizeof(Method)},
+        {"Boolean", "Obj", boolean_methods, sizeof(boolean_methods) / sizeof(Method)},
+        {"Nothing", "Obj", nothing_methods, sizeof(nothing_methods) / sizeof(Method)},
+        {"Int", "Obj", int_methods, sizeof(int_methods) / sizeof(Method)},
+    };
+
+}
+
+#endif //AST_BUILTINCLASSES_H
@@ -2,28 +2,25 @@
 #include <ostream>
 #include <map>
 #include "CodegenContext.h"
+#include "Messages.h"
 #include "staticsemantics.cxx"
 #include "ASTNode.h"
 
 using namespace std;
 
-void Context::emit(string s) { 
-    object_code << s  << endl; 
-    cout << s << endl;
-}
-
 /* Getting the name of a "register" (really a local variable in C)
     * has the side effect of emitting a declaration for the variable.
     */
-string Context::alloc_reg(string type) {
+string Context::alloc_reg(Symbol type) {
     int reg_num = next_reg_num++;
+    ++ssc->registers;
     string reg_name = "reg__" + to_string(reg_num);
-    object_code << "obj_" << type << " " << reg_name << ";" << endl;
+    emit("obj_", type, " ", reg_name, ";");
     return reg_name;
 }
 
 void Context::free_reg(string reg) {
-    this->emit(string("// Free ") + reg);
+    this->emit("// Free ", reg);
 }
 
 /* Get internal name for a calculator variable.
@@ -32,110 +29,100 @@ void Context::free_reg(string reg) {
     * we should buffer up the program to avoid this.)
     */    
 
-string Context::get_type(AST::ASTNode& node) {
-    TypeNode classnode = ssc->hierarchy[classname];
-    MethodTable methodt;
-    map<string, string>* vars;
-    if (methodname == "constructor" || methodname == classname) {
-        methodt = classnode.construct;
-        vars = methodt.vars;
-    }
-    else {
-        if (methodname == "__pgm__") {
-            vars = &classnode.instance_vars;
-        }
-        else{ 
-            methodt = classnode.methods[methodname];
-            vars = methodt.vars;
-        }
-    }
-    class_and_method *info = new class_and_method(classname, methodname);
-    string type = node.type_infer(ssc, vars, info);
-    return type;
+/* The type checking settled on for node.  Only a node no unit's
+ * inference reached has to be inferred here.
+ */
+Symbol Context::get_type(AST::ASTNode node) {
+    if (ssc->expr_types.has(node.id())) { return ssc->expr_types.get(node.id()); }
+    ++ssc->codegen_infers;
+    class_and_method info(classname, methodname);
+    return node.type_infer(ssc, ssc->vars_of(classname, methodname), &info, &ssc->expr_types);
 }
 
-string Context::get_local_var(string &ident) {
+string Context::get_local_var(Symbol ident) {
     if (local_vars.count(ident) == 0) {
         string internal = string("var_") + ident;
         local_vars[ident] = internal;
         // We'll need a declaration in the generated code
         // find type of local var?
-        TypeNode classnode = ssc->hierarchy[classname];
-        MethodTable methodt;
-        map<string, string>* vars;
-        if (methodname == "constructor" || methodname == classname) {
-            methodt = classnode.construct;
-            vars = methodt.vars;
-        }
-        else {
-            if (methodname == "__pgm__") {
-                vars = &classnode.instance_vars;
-            }
-            else{ 
-                methodt = classnode.methods[methodname];
-                vars = methodt.vars;
-            }
-        }
-        string type = (*vars)[ident];
-        this->emit(string("obj_") + type + " " + internal + ";");
+        Symbol type = ssc->vars_of(classname, methodname)->get(ident);
+        this->emit("obj_", type, " ", internal, ";");
         return internal;
     }
     return local_vars[ident];
 }
 
+/* Make ident a name for internal, which is already declared */
+void Context::bind_local(Symbol ident, const string& internal) {
+    local_vars[ident] = internal;
+}
+
+/* The parameters of a method or constructor, "obj_T var_x, ...", with
+ * each formal bound to its parameter
+ */
+string Context::bind_formals(AST::ASTNode formals) {
+    string params = "";
+    for (AST::ASTNode formal: formals) {
+        string internal = string("var_") + formal.child(0).text();
+        bind_local(formal.child(0).text(), internal);
+        if (!params.empty()) { params += ", "; }
+        params += "obj_" + formal.child(1).text().str() + " " + internal;
+    }
+    return params;
+}
+
 string Context::new_branch_label(const char* prefix) {
+    ++ssc->labels;
     return string(prefix) + "_" + to_string(++next_label_num);
 }
 
+/* The class's fields, by slot (see Fields) */
 void Context::emit_instance_vars() {
-    TypeNode classnode = ssc->hierarchy[classname];
-    map<string, string> instancevars = classnode.instance_vars;
-    for (map<string, string>::iterator iter = instancevars.begin(); iter != instancevars.end(); ++iter) {
-        emit("obj_" + iter->second + " " + iter->first + ";");
+    const map<Symbol, Symbol>& instancevars = ssc->find_class(classname)->instance_vars;
+    const Fields& fields = ssc->fields_of(classname);
+    for (size_t slot = 0; slot < fields.names.size(); ++slot) {
+        map<Symbol, Symbol>::const_iterator type = instancevars.find(fields.names[slot]);
+        emit("obj_", type == instancevars.end() ? sym::Obj : type->second, " ", fields.names[slot], ";");
     }
 }
 
-string Context::get_formal_argtypes(string methodname) {
-    TypeNode classnode = ssc->hierarchy[classname];
-    MethodTable method;
-    if (methodname == "constructor") {
-        method = classnode.construct;
-    }
-    else {
-        method = classnode.methods[methodname];
-    }
+/* The parameter types of a method, as Builtins.h writes them: first the
+ * receiver, an obj_ of the class that defines the method, then the
+ * formals.  A constructor has no receiver.
+ */
+string Context::get_formal_argtypes(Symbol methodname) {
+    const TypeNode* classnode = ssc->find_class(classname);
+    const MethodTable* method = &classnode->construct;
     string formals = "";
-    for (string s: method.formalargtypes) {
+    if (methodname != sym::constructor) {
+        method = ssc->find_method(classname, methodname);
         formals += "obj_";
-        formals += s;
-        formals += ", ";
+        formals += method->inheritedfrom.str();
     }
-    int strlen = formals.length();
-    if (strlen > 2) {
-        formals = formals.erase(strlen - 2, 2); // erase the final ", "
+    for (Symbol s: method->formalargtypes) {
+        if (!formals.empty()) { formals += ", "; }
+        formals += "obj_";
+        formals += s.str();
     }
     return formals;
 }
 
 void Context::emit_method_sigs() {
-    TypeNode classnode = ssc->hierarchy[classname];
-    for (string method: classnode.methodlist) {
-        MethodTable mt = classnode.methods[method];
-        emit("obj_" + mt.returntype + " (*" + method + ") (" + get_formal_argtypes(method) + ");");
+    const VTable& vtable = ssc->vtable_of(classname);
+    for (size_t slot = 0; slot < vtable.names.size(); ++slot) {
+        Symbol method = vtable.names[slot];
+        emit("obj_", vtable.methods[slot]->returntype, " (*", method, ") (", get_formal_argtypes(method), ");");
     }
 }
 
 void Context::emit_the_class_struct() {
-    emit("struct  class_" + classname + "_struct  the_class_" + classname + "_struct = {");
-    TypeNode classnode = ssc->hierarchy[classname];
-    string output = "";
-    output += "new_" + classname;
-    for (string method: classnode.methodlist) {
-        output += ",\n";
-        MethodTable mt = classnode.methods[method];
-        output += mt.inheritedfrom + "_method_" + method;
+    emit("struct  class_", classname, "_struct  the_class_", classname, "_struct = {");
+    const VTable& vtable = ssc->vtable_of(classname);
+    object_code << "new_" << classname;
+    for (size_t slot = 0; slot < vtable.names.size(); ++slot) {
+        object_code << ",\n" << vtable.methods[slot]->inheritedfrom << "_method_" << vtable.names[slot];
     }
-    emit(output);                
+    emit();
     emit("};\n");
 }
 
@@ -2,8 +2,9 @@
 #ifndef AST_CODEGENCONTEXT_H
 #define AST_CODEGENCONTEXT_H
 
-#include <ostream>
 #include <map>
+#include "Symbol.h"
+#include "Sink.h"
 
 using namespace std;
 
@@ -13,27 +14,40 @@ namespace AST {class ASTNode; }
 class Context {
     int next_reg_num = 0;
     int next_label_num = 0;
-    map<string, string> local_vars;
-    ostream &object_code;
+    map<Symbol, string> local_vars;
+    Sink &object_code;
 public:
-    string classname;
-    string methodname;
+    Symbol classname;
+    Symbol methodname;
     StaticSemantics* ssc;
 
-    explicit Context(ostream &out, StaticSemantics* ss, string clsname, string methname) : 
+    explicit Context(Sink &out, StaticSemantics* ss, Symbol clsname, Symbol methname) : 
         object_code{out}, ssc{ss}, classname{clsname}, methodname{methname} {};
 
-    void emit(string s);
+    /* A copy of other that writes its code to out instead */
+    Context(const Context& other, Sink &out) :
+        next_reg_num{other.next_reg_num}, next_label_num{other.next_label_num}, local_vars{other.local_vars},
+        object_code{out}, classname{other.classname}, methodname{other.methodname}, ssc{other.ssc} {};
 
-    string alloc_reg(string type);
+    /* A line of generated code, the concatenation of parts */
+    template<class... Parts>
+    void emit(const Parts&... parts) {
+        int append[] = {0, (object_code << parts, 0)...};
+        (void) append;
+        object_code << '\n';
+    }
+
+    string alloc_reg(Symbol type);
 
     void free_reg(string reg);
 
-    string get_local_var(string &ident);
-    string get_type(AST::ASTNode& node);
+    string get_local_var(Symbol ident);
+    void bind_local(Symbol ident, const string& internal);
+    string bind_formals(AST::ASTNode formals);
+    Symbol get_type(AST::ASTNode node);
     string new_branch_label(const char* prefix);
     void emit_instance_vars();
-    string get_formal_argtypes(string methodname);
+    string get_formal_argtypes(Symbol methodname);
     void emit_method_sigs();
     void emit_the_class_struct();
 };
@@ -0,0 +1,504 @@
+//
+// libquack: glues together a lexer, a parser, the static
+// semantic checker and the code generator (see Compiler.h).
+//
+
+#include "Compiler.h"
+#include "lex.yy.h"
+#include "ASTNode.h"
+#include "Messages.h"
+#include "staticsemantics.cxx"
+#include "CodegenContext.h"
+#include "Sink.h"
+#include "Arena.h"
+#include "Source.h"
+#include "Protocol.h"
+#include "Timing.h"
+#include "Memory.h"
+
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+namespace quack {
+
+class Driver {
+    int debug_level = 0;
+    Arena arena_;   // Owns everything derived from the AST; constructed first, released last
+    AST::Tree tree_;
+    const SourceBuffer& source_;
+public:
+    /* The source must outlive the driver: string literals in the AST point into it */
+    explicit Driver(const SourceBuffer& src) :
+            arena_{}, source_(src), lexer(reflex::Input(src.data(), src.size())), parser(new yy::parser(lexer, &tree_)) {
+        lexer.source = &src;
+        lexer.filename = src.name();
+        Arena::current() = &arena_;
+        arena_.phase("parse");
+    }
+
+    ~Driver() {
+        delete parser;
+        Arena::current() = nullptr;
+    }
+
+    void debug() { debug_level = 1; }
+
+    Arena& arena() { return arena_; }
+
+    AST::Tree& tree() { return tree_; }
+
+    /* True if the program parsed; its root is then tree().root() */
+    bool parse() {
+        parser->set_debug_level(debug_level); // 0 = no debugging, 1 = full tracing
+        parser->set_debug_stream(report::err());
+        // std::cout << "Running parser\n";
+        int result = parser->parse();
+        if (result == 0 && report::ok()) {  // 0 == success, 1 == failure
+            // std::cout << "Extracting result\n";
+            if (!tree_.has_root()) {
+                report::out() << "But I got a null result!  How?!\n";
+                return false;
+            }
+            return true;
+        } else {
+            // std::cout << "Parse failed, no tree\n";
+            return false;
+        }
+    }
+
+    /* Scan the whole input with a scanner of its own, charging the time
+     * to "lex" in timings, and return the number of tokens.  The parser
+     * calls its scanner a token at a time, too often to time each call,
+     * so scanning is timed separately.  Its messages are dropped; the
+     * parser's scanner reports the same ones.
+     */
+    long time_scan(Timings& timings) {
+        std::ostringstream dropped;
+        report::Scope quiet(dropped, dropped);
+        yy::Lexer scanner(reflex::Input(source_.data(), source_.size()));
+        scanner.source = &source_;
+        scanner.filename = source_.name();
+        yy::parser::semantic_type value;
+        yy::parser::location_type loc;
+        long tokens = 0;
+        timings.skip();
+        while (scanner.yylex(&value, &loc) > 0) {
+            ++tokens;
+        }
+        timings.lap("lex");
+        return tokens;
+    }
+
+    /* Run the scanner alone over the whole input; returns the number of tokens */
+    long scan() {
+        yy::parser::semantic_type value;
+        yy::parser::location_type loc;
+        long tokens = 0;
+        while (lexer.yylex(&value, &loc) > 0) {
+            ++tokens;
+        }
+        return tokens;
+    }
+
+private:
+    yy::Lexer lexer;
+    yy::parser *parser;
+};
+
+/* Each class is generated with a copy of the context, as it always
+ * was, but into buffers of its own: a reused class takes its code and
+ * listing from the cache instead, and those of a class in fresh are
+ * kept for storing.
+ */
+static void generate_code(AST::ASTNode astroot, StaticSemantics* ssc, Sink& outfile,
+                          std::map<Symbol, CachedClass>& fresh) {
+    //outfile << "Writing this to a file.\n";
+    Context ctx(outfile, ssc, "", "");
+    // Prologue
+    ctx.emit("#include <stdio.h>");
+    ctx.emit("#include \"Builtins.h\"");
+    ctx.emit("int main(int argc, char **argv) {");
+    // Body of generated code: the classes, then the main program
+    std::string target = ctx.alloc_reg("Obj");
+    for (AST::ASTNode cls: astroot[0]) {
+        Symbol classname = cls[0].get_var();
+        if (ssc->reused.count(classname)) {
+            outfile << ssc->cached[classname].code;
+            report::out() << ssc->cached[classname].listing;
+            continue;
+        }
+        Sink code;
+        std::ostringstream listing;
+        {
+            report::Scope capture(listing, report::err());
+            Context classcon(ctx, code);
+            classcon.classname = classname;
+            cls.genR(&classcon, target);
+        }
+        outfile << code;
+        report::out() << listing.str();
+        if (fresh.count(classname)) {
+            fresh[classname].code = code.str();
+            fresh[classname].listing = listing.str();
+        }
+    }
+    Context pgmcon(ctx);
+    pgmcon.classname = sym::pgm;
+    pgmcon.methodname = sym::pgm;
+    astroot[1].genR(&pgmcon, target);
+    // Coda
+    //ctx.emit(std::string(R"(printf("-> %d\n",)")
+    //    + target + ");");
+    ctx.emit("}");
+}
+
+// --- The class cache (see ClassCache in Compiler.h)
+
+/* 64-bit FNV-1a */
+static uint64_t hash_text(const std::string& text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c: text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static std::string hex(uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    std::string text(16, '0');
+    for (int i = 15; i >= 0; --i, value >>= 4) {
+        text[i] = digits[value & 0xf];
+    }
+    return text;
+}
+
+/* Hash of the syntax tree of a class; names gets every identifier in it */
+static std::string class_digest(AST::ASTNode cls, std::set<Symbol>& names) {
+    std::string text;
+    std::vector<AST::ASTNode> stack(1, cls);
+    while (!stack.empty()) {
+        AST::ASTNode n = stack.back();
+        stack.pop_back();
+        text += std::to_string(static_cast<int>(n.kind()));
+        text += ' ';
+        switch (n.kind()) {
+        case AST::Kind::Ident:
+            names.insert(n.text());
+            protocol::put_frame(text, n.text().str());
+            break;
+        case AST::Kind::Stub:
+            protocol::put_frame(text, n.text().str());
+            break;
+        case AST::Kind::IntConst:
+            text += std::to_string(n.int_value());
+            break;
+        case AST::Kind::StrConst:
+            protocol::put_frame(text, n.literal().str());
+            break;
+        default:
+            break;
+        }
+        text += ' ';
+        text += std::to_string(n.size());
+        text += '\n';
+        for (uint32_t i = n.size(); i > 0; --i) {
+            stack.push_back(n[i - 1]);
+        }
+    }
+    return hex(hash_text(text));
+}
+
+/* What each class's key is made from: the digests of the class and of
+ * every class it depends on, i.e. its ancestors and the classes it
+ * names, and theirs in turn.  Empty if two classes share a name (or
+ * one takes a builtin's), since then names don't identify classes.
+ */
+static std::map<Symbol, std::string> class_materials(AST::ASTNode classes, int version) {
+    std::map<Symbol, std::string> digests;
+    std::map<Symbol, std::set<Symbol>> uses;
+    for (AST::ASTNode cls: classes) {
+        Symbol classname = cls[0].text();
+        if (digests.count(classname) || StaticSemantics::builtins().count(classname)) {
+            return std::map<Symbol, std::string>();
+        }
+        digests[classname] = class_digest(cls, uses[classname]);  // the superclass is among the names
+    }
+    std::map<Symbol, std::string> materials;
+    for (std::map<Symbol, std::string>::iterator iter = digests.begin(); iter != digests.end(); ++iter) {
+        std::set<Symbol> seen;
+        std::vector<Symbol> work(1, iter->first);
+        seen.insert(iter->first);
+        while (!work.empty()) {
+            Symbol classname = work.back();
+            work.pop_back();
+            for (Symbol used: uses[classname]) {
+                if (digests.count(used) && seen.insert(used).second) {
+                    work.push_back(used);
+                }
+            }
+        }
+        std::vector<std::string> lines;
+        for (Symbol classname: seen) {
+            lines.push_back(classname.str() + " " + digests[classname] + "\n");
+        }
+        std::sort(lines.begin(), lines.end());
+        // Another version of the compiler may check or generate differently (see CACHE_VERSION)
+        std::string material = "quack class cache " + std::to_string(version) + "\nclass " + iter->first.str() + "\n";
+        for (const std::string& line: lines) {
+            material += line;
+        }
+        materials[iter->first] = material;
+    }
+    return materials;
+}
+
+static std::string cache_key(const std::string& material) {
+    return hex(hash_text(material));
+}
+
+/* Entries are a sequence of frames (as in Protocol.h):
+ *     material  instance-vars  constructor-vars  methods  code  listing
+ * where a table of variables is its size followed by a name and a type
+ * for each, and methods is their number followed by a name and a table
+ * for each.  The material is compared on loading, so two classes whose
+ * keys collide don't get each other's entries.
+ */
+static void put_vars(std::string& entry, const std::map<Symbol, Symbol>& vars) {
+    protocol::put_frame(entry, std::to_string(vars.size()));
+    for (std::map<Symbol, Symbol>::const_iterator iter = vars.begin(); iter != vars.end(); ++iter) {
+        protocol::put_frame(entry, iter->first.str());
+        protocol::put_frame(entry, iter->second.str());
+    }
+}
+
+static std::string write_entry(const std::string& material, const CachedClass& cls) {
+    std::string entry;
+    protocol::put_frame(entry, material);
+    put_vars(entry, cls.instance_vars);
+    put_vars(entry, cls.constructor_vars);
+    protocol::put_frame(entry, std::to_string(cls.method_vars.size()));
+    for (std::map<Symbol, std::map<Symbol, Symbol>>::const_iterator iter = cls.method_vars.begin(); iter != cls.method_vars.end(); ++iter) {
+        protocol::put_frame(entry, iter->first.str());
+        put_vars(entry, iter->second);
+    }
+    protocol::put_frame(entry, cls.code);
+    protocol::put_frame(entry, cls.listing);
+    return entry;
+}
+
+static bool get_number(const std::string& entry, size_t& pos, size_t& number) {
+    std::string text;
+    if (!protocol::get_frame(entry, pos, text) || text.empty() || text.size() > 9) { return false; }
+    number = 0;
+    for (char c: text) {
+        if (c < '0' || c > '9') { return false; }
+        number = number * 10 + (c - '0');
+    }
+    return true;
+}
+
+static bool get_vars(const std::string& entry, size_t& pos, std::map<Symbol, Symbol>& vars) {
+    size_t count;
+    if (!get_number(entry, pos, count)) { return false; }
+    for (size_t i = 0; i < count; ++i) {
+        std::string name, type;
+        if (!protocol::get_frame(entry, pos, name) || !protocol::get_frame(entry, pos, type)) { return false; }
+        vars[name] = type;
+    }
+    return true;
+}
+
+/* False if the entry is damaged or belongs to some other class */
+static bool read_entry(const std::string& entry, const std::string& material, CachedClass& cls) {
+    size_t pos = 0, methods;
+    std::string stored;
+    if (!protocol::get_frame(entry, pos, stored) || stored != material) { return false; }
+    if (!get_vars(entry, pos, cls.instance_vars) || !get_vars(entry, pos, cls.constructor_vars)) { return false; }
+    if (!get_number(entry, pos, methods)) { return false; }
+    for (size_t i = 0; i < methods; ++i) {
+        std::string name;
+        if (!protocol::get_frame(entry, pos, name) || !get_vars(entry, pos, cls.method_vars[name])) { return false; }
+    }
+    return protocol::get_frame(entry, pos, cls.code) && protocol::get_frame(entry, pos, cls.listing)
+        && pos == entry.size();
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double ms_since(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+Result compile(const char* text, size_t size, const std::string& name, const Options& opts) {
+    memory::Counting counting(opts.mem_report != 0);
+    // Phase times, allocations and counters are reported for either
+    bool report_phases = opts.time_report || opts.mem_report;
+    Result result;
+    std::ostringstream out, err;
+    report::Scope diagnostics(out, err);
+    SourceBuffer source;
+    source.assign(name, text, size);
+    result.stats.source_bytes = size;
+    {
+        Driver driver(source);
+        Timings timings;   // Kept whether or not they are asked for; laps are cheap
+        std::vector<std::pair<std::string, long>> counters;   // Those of checking and code generation
+        Clock::time_point start = Clock::now();
+        if (opts.lex_only) {
+            result.stats.tokens = driver.scan();
+            result.stats.parse_ms = ms_since(start);
+            double mb = size / (1024.0 * 1024.0);
+            out << name << ": " << result.stats.tokens << " tokens, " << size << " bytes in "
+                << result.stats.parse_ms << " ms (" << mb / (result.stats.parse_ms / 1000) << " MB/s)" << std::endl;
+        } else {
+            if (opts.debug) driver.debug();
+            TimedPhase lexing;
+            if (report_phases) {
+                result.stats.tokens = driver.time_scan(timings);
+                lexing = timings.phases().back();
+                start = Clock::now();
+            }
+            Timer parsing;
+            bool parsed = driver.parse();
+            result.stats.parse_ms = ms_since(start);
+            // The parser ran its own scanner; parse is the rest of the time
+            long parse_bytes = (long) parsing.bytes() - (long) lexing.bytes;
+            timings.add("parse", parsing.wall_ms() - lexing.wall_ms, parsing.cpu_ms() - lexing.cpu_ms,
+                        std::max(parsing.allocations() - lexing.allocations, 0L), (size_t) std::max(parse_bytes, 0L));
+            timings.skip();
+            if (parsed) {
+                // std::cout << "Parsed!\n";
+                AST::ASTNode root = driver.tree().root();
+                if (opts.emit & EMIT_AST) {
+                    AST::AST_print_context context;
+                    root.json(out, context);
+                    out << std::endl;
+                    timings.lap("json");
+                }
+                // STATIC SEMANTIC CHECK ON TREE
+                // return (or null pointer if error)
+                driver.arena().phase("check");
+                start = Clock::now();
+                StaticSemantics semanticChecker(root);
+                semanticChecker.timings = &timings;
+                semanticChecker.listing = (opts.emit & EMIT_HIERARCHY) != 0;
+                semanticChecker.threads = opts.check_threads;
+                std::map<Symbol, std::string> materials;
+                if (opts.cache) {
+                    materials = class_materials(root[0], opts.cache_version);
+                    for (std::map<Symbol, std::string>::iterator iter = materials.begin(); iter != materials.end(); ++iter) {
+                        std::string entry;
+                        CachedClass cls;
+                        if (opts.cache->load(cache_key(iter->second), entry) && read_entry(entry, iter->second, cls)) {
+                            semanticChecker.cached[iter->first] = cls;
+                        }
+                    }
+                    timings.lap("cache");
+                }
+                // Checked: every pass got through and reported no errors
+                bool checked = semanticChecker.checkAST() != nullptr && report::ok();
+                // Classes to store once their code is generated: those checked
+                // afresh, if checking got through and had nothing to say about them
+                std::map<Symbol, CachedClass> fresh;
+                if (checked) {
+                    for (std::map<Symbol, std::string>::iterator iter = materials.begin(); iter != materials.end(); ++iter) {
+                        if (!semanticChecker.reused.count(iter->first) && !semanticChecker.noisy.count(iter->first)) {
+                            fresh[iter->first] = semanticChecker.save_class(iter->first);
+                        }
+                    }
+                }
+                if (opts.cache) {
+                    timings.lap("cache");
+                }
+                result.stats.check_ms = ms_since(start);
+                driver.arena().phase("codegen");
+                start = Clock::now();
+                // A program that failed checking has no C
+                if (checked) {
+                    Sink object_code;
+                    generate_code(root, &semanticChecker, object_code, fresh);
+                    result.c_code = object_code.take();
+                    result.ok = true;
+                    if (opts.emit & EMIT_C) {
+                        out << result.c_code;
+                    }
+                }
+                result.stats.codegen_ms = ms_since(start);
+                timings.lap("generate_code");
+                for (std::map<Symbol, CachedClass>::iterator iter = fresh.begin(); iter != fresh.end(); ++iter) {
+                    const std::string& material = materials[iter->first];
+                    opts.cache->store(cache_key(material), write_entry(material, iter->second));
+                }
+                if (opts.cache) {
+                    timings.lap("cache");
+                    result.stats.cache_hits = semanticChecker.reused.size();
+                    result.stats.cache_misses = root[0].size() - semanticChecker.reused.size();
+                }
+                if (report_phases) {
+                    counters.push_back(std::make_pair("typeCheck unit runs", semanticChecker.unit_runs));
+                    counters.push_back(std::make_pair("typeCheck waves", semanticChecker.waves));
+                    counters.push_back(std::make_pair("typeCheck statement visits", semanticChecker.inferred.statement_visits));
+                    counters.push_back(std::make_pair("Call type_infer", semanticChecker.inferred.call_infers));
+                    counters.push_back(std::make_pair("registers", semanticChecker.registers));
+                    counters.push_back(std::make_pair("labels", semanticChecker.labels));
+                    counters.push_back(std::make_pair("generate_code type_infer", semanticChecker.codegen_infers));
+                }
+            } else {
+                out << "No tree produced." << std::endl;
+            }
+        }
+        result.stats.ast_nodes = driver.tree().nodes();
+        result.stats.ast_bytes = driver.tree().bytes();
+        if (report_phases && !opts.lex_only) {
+            for (const TimedPhase& phase: timings.phases()) {
+                PhaseTime time;
+                time.name = phase.name;
+                time.wall_ms = phase.wall_ms;
+                time.cpu_ms = phase.cpu_ms;
+                time.allocations = phase.allocations;
+                time.bytes = phase.bytes;
+                result.stats.phase_times.push_back(time);
+            }
+            result.stats.counters.push_back(std::make_pair("tokens", result.stats.tokens));
+            result.stats.counters.push_back(std::make_pair("AST nodes", (long) result.stats.ast_nodes));
+            std::vector<long> by_kind;
+            for (AST::Node n = 0; n < driver.tree().nodes(); ++n) {
+                size_t kind = static_cast<size_t>(driver.tree().kind(n));
+                if (kind >= by_kind.size()) { by_kind.resize(kind + 1); }
+                ++by_kind[kind];
+            }
+            for (size_t kind = 0; kind < by_kind.size(); ++kind) {
+                if (by_kind[kind] > 0) {
+                    std::string name = std::string("AST nodes: ") + AST::kind_name(static_cast<AST::Kind>(kind));
+                    result.stats.counters.push_back(std::make_pair(name, by_kind[kind]));
+                }
+            }
+            result.stats.counters.insert(result.stats.counters.end(), counters.begin(), counters.end());
+        }
+        Arena& arena = driver.arena();
+        result.stats.arena_bytes = arena.bytes_used();
+        result.stats.symbols = SymbolTable::instance().size();
+        result.stats.symbol_bytes = SymbolTable::instance().bytes();
+        for (const std::string& phase: arena.phases()) {
+            result.stats.phase_bytes.push_back(std::make_pair(phase, arena.bytes_used(phase)));
+        }
+        if (opts.arena_stats && !opts.lex_only) {
+            err << name << ": ";
+            arena.report(err);
+            err << name << ": AST: " << result.stats.ast_nodes << " nodes in "
+                << result.stats.ast_bytes << " bytes" << std::endl;
+        }
+    }
+    result.output = out.str();
+    result.diagnostics = err.str();
+    return result;
+}
+
+void prepare() {
+    StaticSemantics::builtins();
+}
+
+}
@@ -0,0 +1,131 @@
+//
+// libquack: the Quack compiler as a library.
+//
+// Source text goes in, C comes out.  The library reads and writes no
+// files and prints nothing; everything a compilation would print is
+// returned in its Result.  Compilations share no state (apart from a
+// ClassCache the caller hands them), so several may run at once on
+// different threads.
+//
+//     quack::Result result = quack::compile(text);
+//     if (result.ok) { ... result.c_code ... }
+//
+// bin/parser is a client of this library; link with libquack.a or
+// libquack.so (and RE/flex's libreflex).
+//
+
+#ifndef AST_COMPILER_H
+#define AST_COMPILER_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+namespace quack {
+
+    /* Classes checked and generated by earlier compilations.
+     *
+     * An entry holds what type checking found for one class (its
+     * instance variables and the variable tables of its methods) and the
+     * C generated for it.  Its key is a hash of the class's syntax tree
+     * together with those of its ancestors and of every class it names,
+     * so any change that could affect the class selects a different
+     * entry.  A class is only stored if checking it printed nothing.
+     *
+     * The library decides what goes in; the caller decides where it is
+     * kept.  load and store may be called from several threads at once.
+     */
+    class ClassCache {
+    public:
+        virtual ~ClassCache() {}
+        /* The entry stored under key, if there is one */
+        virtual bool load(const std::string& key, std::string& entry) = 0;
+        virtual void store(const std::string& key, const std::string& entry) = 0;
+    };
+
+    /* The version of what compilations store in a ClassCache.  It is
+     * part of every entry's key, so entries stored by another version
+     * are never used.  Bump it whenever a change to checking or code
+     * generation changes what is stored for a class: its variable
+     * types, its C or its listing.
+     */
+    const int CACHE_VERSION = 6;
+
+    /* Listings a compilation can add to Result::output (Options::emit) */
+    enum Emit {
+        EMIT_AST = 1,         // The syntax tree, as JSON
+        EMIT_HIERARCHY = 2,   // The class hierarchy, once checked
+        EMIT_C = 4            // The generated C (also in Result::c_code)
+    };
+
+    struct Options {
+        int emit = 0;         // Emit flags; by default the output has only the checker's messages
+        int debug = 0;        // 1 = trace the parser into the diagnostics
+        int arena_stats = 0;  // 1 = add arena usage per phase, and the AST size, to the diagnostics
+        int lex_only = 0;     // 1 = just scan, and report throughput in the output
+        int time_report = 0;  // 1 = fill in Stats::phase_times and Stats::counters
+        int mem_report = 0;   // The same, and count heap allocations per phase (see Memory.h)
+        int check_threads = 1;  // Type check methods and constructors on this many threads
+        ClassCache* cache = nullptr;  // Reuse unchanged classes from earlier compilations
+        int cache_version = CACHE_VERSION;  // Entries stored under another version are not reused
+    };
+
+    /* Wall clock and CPU time of one phase; CPU time is the compiling
+     * thread's.  With Options::mem_report, also the heap allocations it
+     * made, if the program counts them (see Memory.h); else zero.
+     */
+    struct PhaseTime {
+        std::string name;
+        double wall_ms = 0;
+        double cpu_ms = 0;
+        long allocations = 0;
+        size_t bytes = 0;
+    };
+
+    struct Stats {
+        size_t source_bytes = 0;
+        long tokens = 0;             // Counted only with lex_only, time_report or mem_report
+        size_t ast_nodes = 0;
+        size_t ast_bytes = 0;        // The AST's arrays
+        size_t arena_bytes = 0;      // Tables and everything else the compilation built
+        size_t symbols = 0;          // Interned names in the process, after this compilation
+        size_t symbol_bytes = 0;     // What they take up; they are never freed (see Symbol.h)
+        std::vector<std::pair<std::string, size_t>> phase_bytes;   // The same, by phase
+        double parse_ms = 0;
+        double check_ms = 0;
+        double codegen_ms = 0;
+        size_t cache_hits = 0;       // Classes reused from Options::cache
+        size_t cache_misses = 0;     // Classes checked and generated afresh while using it
+        // With Options::time_report or mem_report: each phase that ran, in order
+        // (lex is a separate scan of the input, and parse the rest of
+        // parsing), and counts of what the phases did
+        std::vector<PhaseTime> phase_times;
+        std::vector<std::pair<std::string, long>> counters;
+    };
+
+    struct Result {
+        bool ok = false;           // The program parsed and checked without errors, and c_code was generated
+        std::string c_code;
+        std::string output;        // Type checker messages, and the listings Options::emit asks for
+        std::string diagnostics;   // Errors from the scanner and parser, traces
+        Stats stats;
+    };
+
+    /* Compile size bytes of Quack source.  name is what messages call
+     * the input.  The text is only read during the call.
+     */
+    Result compile(const char* source, size_t size, const std::string& name,
+                   const Options& opts = Options());
+
+    inline Result compile(const std::string& source, const Options& opts = Options()) {
+        return compile(source.data(), source.size(), "<source>", opts);
+    }
+
+    /* Build the tables every compilation shares (the builtin classes)
+     * now, rather than during the first compile.
+     */
+    void prepare();
+}
+
+#endif //AST_COMPILER_H
@@ -0,0 +1,66 @@
+//
+// Heap accounting for a compilation (parser --mem-report).
+//
+// The library only reads a per-thread tally of heap allocations; the
+// counting is done by replacement operator new, which a program links
+// in if it wants the numbers (MemoryHook.cxx, in bin/parser).  Without
+// it the tally stays at zero.  Only allocations made while a Counting
+// is in scope on the thread are counted, so compilations running side
+// by side (-j, --server) are each charged with their own.
+//
+
+#ifndef AST_MEMORY_H
+#define AST_MEMORY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace memory {
+
+    struct Tally {
+        bool on = false;          // A Counting is in scope
+        long allocations = 0;     // operator new calls while on
+        size_t bytes = 0;         // and the bytes they asked for
+    };
+
+    /* This thread's tally.  Constant-initialized, so the allocation
+     * hook can use it before anything else on the thread has run.
+     */
+    inline Tally& tally() {
+        static thread_local Tally t;
+        return t;
+    }
+
+    /* Counts this thread's allocations (if on) for as long as it is in scope */
+    class Counting {
+        bool was_on_;
+    public:
+        explicit Counting(bool on = true) : was_on_{tally().on} { tally().on = was_on_ || on; }
+        ~Counting() { tally().on = was_on_; }
+        Counting(const Counting&) = delete;
+        Counting& operator=(const Counting&) = delete;
+    };
+
+    /* Where counted allocations came from: the innermost function that
+     * isn't part of the allocator or the standard library
+     */
+    struct Site {
+        string function;
+        long allocations = 0;
+        size_t bytes = 0;
+    };
+
+    /* The n sites that allocated the most bytes on this thread since
+     * the last call, most first; forgets them.  Defined by the
+     * allocation hook (MemoryHook.cxx).
+     */
+    vector<Site> take_sites(size_t n);
+
+    /* Peak resident set size of the process so far, in KB */
+    long peak_rss_kb();
+}
+
+#endif //AST_MEMORY_H
@@ -0,0 +1,161 @@
+//
+// Replacement operator new and delete that keep the tallies of
+// Memory.h, for parser --mem-report.
+//
+// Each counted allocation also records the few return addresses above
+// it.  They are only turned into names when the sites are taken, and
+// the first frame outside the allocator and the standard library
+// names the site.  Names come from dladdr, so the program is linked
+// with -rdynamic; functions it doesn't export show as file+offset.
+//
+
+#include "Memory.h"
+
+#include <new>
+#include <map>
+#include <array>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <sys/resource.h>
+
+namespace {
+
+    const int DEPTH = 16;
+    typedef std::array<void*, DEPTH> Stack;
+
+    struct Count {
+        long allocations = 0;
+        size_t bytes = 0;
+    };
+
+    // Allocations by the stack they were made from, on this thread.
+    // Created on the first counted allocation and freed by take_sites.
+    thread_local std::map<Stack, Count>* stacks = nullptr;
+    thread_local bool recording = false;   // Recording allocates, too; those aren't counted
+
+    // Frames 0 and 1 of a recorded stack are record and allocate
+    const int HOOK_FRAMES = 2;
+
+    __attribute__((noinline)) void record(size_t size) {
+        if (recording) { return; }
+        memory::Tally& tally = memory::tally();
+        ++tally.allocations;
+        tally.bytes += size;
+        recording = true;
+        if (stacks == nullptr) {
+            void* warm[1];
+            backtrace(warm, 1);   // The first call loads the unwinder, which allocates
+            stacks = new std::map<Stack, Count>();
+        }
+        Stack stack;
+        stack.fill(nullptr);
+        backtrace(stack.data(), DEPTH);
+        Count& count = (*stacks)[stack];
+        ++count.allocations;
+        count.bytes += size;
+        recording = false;
+    }
+
+    __attribute__((noinline)) void* allocate(size_t size) {
+        void* p = malloc(size == 0 ? 1 : size);
+        if (p == nullptr) { throw std::bad_alloc(); }
+        if (memory::tally().on) { record(size); }
+        return p;
+    }
+
+    /* The demangled name of the function containing address, without
+     * a template function's return type, or "" if dladdr can't tell
+     */
+    std::string function_at(void* address) {
+        Dl_info info;
+        if (dladdr(address, &info) == 0) { return ""; }
+        if (info.dli_sname == nullptr) {
+            if (info.dli_fname == nullptr) { return ""; }
+            char offset[32];
+            snprintf(offset, sizeof offset, "+0x%lx",
+                     (unsigned long) ((char*) address - (char*) info.dli_fbase));
+            return std::string(info.dli_fname) + offset;
+        }
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = status == 0 ? demangled : info.dli_sname;
+        free(demangled);
+        size_t open = name.find_first_of("<(");
+        size_t space = name.rfind(' ', open);
+        if (name.compare(0, 9, "operator ") != 0 && space != std::string::npos && open != std::string::npos) {
+            name = name.substr(space + 1);
+        }
+        return name;
+    }
+
+    bool in_allocator(const std::string& function) {
+        static const char* const prefixes[] = {
+            "operator new", "std::", "__gnu_cxx::", "Arena::"
+        };
+        for (const char* prefix: prefixes) {
+            if (function.compare(0, strlen(prefix), prefix) == 0) { return true; }
+        }
+        return false;
+    }
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try { return allocate(size); } catch (const std::bad_alloc&) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try { return allocate(size); } catch (const std::bad_alloc&) { return nullptr; }
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+namespace memory {
+
+    vector<Site> take_sites(size_t n) {
+        vector<Site> sites;
+        if (stacks == nullptr) { return sites; }
+        std::map<Stack, Count>* taken = stacks;
+        stacks = nullptr;
+        bool was_recording = recording;
+        recording = true;   // Naming allocates; don't count it
+        std::map<std::string, Count> by_function;
+        for (const std::pair<const Stack, Count>& entry: *taken) {
+            std::string function;
+            for (int i = HOOK_FRAMES; i < DEPTH && entry.first[i] != nullptr; ++i) {
+                function = function_at(entry.first[i]);
+                if (!function.empty() && !in_allocator(function)) { break; }
+            }
+            Count& count = by_function[function.empty() ? "?" : function];
+            count.allocations += entry.second.allocations;
+            count.bytes += entry.second.bytes;
+        }
+        delete taken;
+        for (const std::pair<const std::string, Count>& entry: by_function) {
+            Site site;
+            site.function = entry.first;
+            site.allocations = entry.second.allocations;
+            site.bytes = entry.second.bytes;
+            sites.push_back(site);
+        }
+        std::sort(sites.begin(), sites.end(), [](const Site& a, const Site& b) { return a.bytes > b.bytes; });
+        if (sites.size() > n) { sites.resize(n); }
+        recording = was_recording;
+        return sites;
+    }
+
+    long peak_rss_kb() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+}
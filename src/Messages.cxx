@@ -4,16 +4,41 @@
 
 #include "Messages.h"
 #include "location.hh"
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
 
 namespace report {
 
-/* The error count is global */
-static int error_count = 0;           // How many errors so far? */
 const int  error_limit = 5;           // Should be configurable
 
+/* The error count belongs to the compilation in progress on this thread. */
+static thread_local Scope* current = nullptr;
+
+static Scope& state() {
+    if (current == nullptr) {
+        // A message with nowhere to go, or a count nobody will read
+        std::cerr << "Internal error: diagnostic reported outside any report::Scope" << std::endl;
+        abort();
+    }
+    return *current;
+}
+
+Scope::Scope(std::ostream& out, std::ostream& err) : out(out), err(err), enclosing(current) {
+    current = this;
+}
+
+Scope::~Scope() {
+    assert(current == this);  // Scopes nest: the newest one ends first
+    current = enclosing;
+}
+
+std::ostream& out() { return state().out; }
+std::ostream& err() { return state().err; }
+
 void bail()
 {
-    std::cerr << "Too many errors, bailing" << std::endl;;
+    err() << "Too many errors, bailing" << std::endl;;
 }
 
 /* An error that we can locate in the input */
@@ -23,8 +48,8 @@ void bail()
  */
 void error_at(const yy::location& loc, const std::string& msg)
 {
-    std::cerr << msg << " at " << loc << std::endl;
-    if (++error_count > error_limit) {
+    err() << msg << " at " << loc << std::endl;
+    if (++state().error_count > error_limit) {
         bail();
     }
 }
@@ -32,20 +57,29 @@ void error_at(const yy::location& loc, const std::string& msg)
 /* An error that we can't locate in the input */
 void error(const std::string& msg)
 {
-    std::cerr << msg << std::endl;
-    if (++error_count > error_limit) {
+    err() << msg << std::endl;
+    if (++state().error_count > error_limit) {
         bail();
     }
 }
 
 /* Additional diagnostic message, does not count against error limit */
 void note(const std::string& msg) {
-    std::cerr << msg << std::endl;
+    err() << msg << std::endl;
+}
+
+std::ostream& semantic_error() {
+    ++state().error_count;
+    return out();
+}
+
+void count(int errors) {
+    state().error_count += errors;
 }
 
 /* Are we ok? */
 bool ok() {
-    return (error_count == 0);
+    return (state().error_count == 0);
 }
 
-};
\ No newline at end of file
+};
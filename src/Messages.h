@@ -2,16 +2,19 @@
 // Created by Michal Young on 9/14/18.
 //
 
-// This should probably be functions (with a static variable for the count)
-// rather than a class, or else it has to be a singleton because we want
-// one global count. 
+// These are functions rather than a class.  The error count and the
+// streams messages go to belong to the compilation in progress on the
+// calling thread (see report::Scope), so several compilations can run
+// at once, each with its own count.
 //
 
 #ifndef AST_MESSAGES_H
 #define AST_MESSAGES_H
 
-# include "location.hh"
 # include <string>
+# include <ostream>
+
+namespace yy { class location; }  // Generated by bison in location.hh
 
 // Error reporting in one place, so that we can count number of errors,
 // potentially killing the program if there are too many, and also
@@ -21,6 +24,30 @@
 
 namespace report {
 
+    /* Diagnostic state of one compilation.  While a Scope is alive it is
+     * the current state for the thread that created it; the previous one
+     * (if any) is restored when it ends.  Scopes on a thread must end in
+     * the reverse of the order they began.  Reporting on a thread with no
+     * Scope is an internal error.
+     */
+    class Scope {
+    public:
+        Scope(std::ostream& out, std::ostream& err);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        std::ostream& out;    // Listings: AST, class hierarchy, type checker messages
+        std::ostream& err;    // Errors from the scanner and parser
+        int error_count = 0;
+    private:
+        Scope* enclosing;
+    };
+
+    /* Where listings and diagnostics for the current compilation go */
+    std::ostream& out();
+    std::ostream& err();
+
     // Halt execution if there are too many errors
     void bail();
 
@@ -33,6 +60,15 @@ namespace report {
     /* Additional diagnostic message, does not count against error limit */
     void note(const std::string& msg);
 
+    /* A static semantic error, reported with the type checker's messages:
+     * counted, then written to out() by the caller.  The checker reports
+     * every error it finds, so these don't count against the limit. */
+    std::ostream& semantic_error();
+
+    /* Count errors that were reported in a nested Scope, whose messages
+     * the caller passes on to this one */
+    void count(int errors);
+
     /* Is everything ok, or have we encountered errors? */
     bool ok();
 
@@ -0,0 +1,98 @@
+//
+// The pass manager.
+//
+// Checking is a sequence of named passes, each of which either gets
+// through or stops the compilation.  The manager runs them in order
+// and charges each one's time to it (see Timing.h).
+//
+// Analyses remember what they found about a node in a NodeAnalysis, by
+// node number, so later passes look results up instead of walking the
+// tree again.  A result is stamped with the generation of the tree it
+// was found in.  A pass that changes the tree is registered as a
+// transform; when it finishes the manager starts a new generation,
+// and every result found before is stale at once.
+//
+
+#ifndef AST_PASSES_H
+#define AST_PASSES_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "ASTNode.h"
+#include "Timing.h"
+
+using namespace std;
+
+template<class T>
+class NodeAnalysis {
+    vector<T> value_;
+    vector<uint32_t> stamp_;           // Generation value_[n] was found in; 0 = never
+    const uint32_t* generation_;       // The manager's current one
+public:
+    explicit NodeAnalysis(const uint32_t* generation) : generation_{generation} {}
+
+    bool has(AST::Node n) const { return n < stamp_.size() && stamp_[n] == *generation_; }
+    const T& get(AST::Node n) const { return value_[n]; }
+
+    void set(AST::Node n, const T& value) {
+        if (n >= stamp_.size()) {
+            value_.resize(n + 1);
+            stamp_.resize(n + 1, 0);
+        }
+        value_[n] = value;
+        stamp_[n] = *generation_;
+    }
+
+    /* Room for a tree of nodes nodes.  set never grows the arrays after,
+     * so threads may set results for different nodes at once.
+     */
+    void reserve(size_t nodes) {
+        if (nodes > stamp_.size()) {
+            value_.resize(nodes);
+            stamp_.resize(nodes, 0);
+        }
+    }
+};
+
+class PassManager {
+    struct Pass {
+        string name;
+        function<bool()> run;   // False stops the passes after it
+        bool transforms;        // Changes the tree
+    };
+    vector<Pass> passes_;
+    uint32_t generation_ = 1;
+public:
+    void add(const string& name, function<bool()> run, bool transforms = false) {
+        Pass pass;
+        pass.name = name;
+        pass.run = run;
+        pass.transforms = transforms;
+        passes_.push_back(pass);
+    }
+
+    /* A new NodeAnalysis, whose results go stale when the tree changes */
+    template<class T>
+    NodeAnalysis<T> analysis() const { return NodeAnalysis<T>(&generation_); }
+
+    /* The tree has changed: forget every analysis result */
+    void invalidate() { ++generation_; }
+    uint32_t generation() const { return generation_; }
+
+    /* Run the passes in order, until one fails.  Each one's time goes
+     * in timings, if given, under its name.  True if they all got through.
+     */
+    bool run(Timings* timings = nullptr) {
+        for (Pass& pass: passes_) {
+            bool ok = pass.run();
+            if (timings) { timings->lap(pass.name); }
+            if (pass.transforms) { invalidate(); }
+            if (!ok) { return false; }
+        }
+        return true;
+    }
+};
+
+#endif //AST_PASSES_H
@@ -0,0 +1,144 @@
+//
+// Wire format between the compile server (parser --server) and its client.
+//
+// A message is a sequence of frames, each a decimal length, a newline,
+// and that many bytes.  The client connects to the server's Unix socket,
+// sends a request, and shuts down its side of the connection:
+//
+//     request:   name  source
+//     response:  status  out  err  code
+//
+// "name" is used in diagnostics, "status" is the exit status the
+// compilation would have had, "out" and "err" are what it would have
+// printed, and "code" is the generated C (empty if there is none).
+//
+
+#ifndef AST_PROTOCOL_H
+#define AST_PROTOCOL_H
+
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+using namespace std;
+
+namespace protocol {
+
+    inline void put_frame(string& msg, const string& body) {
+        msg += to_string(body.size());
+        msg += '\n';
+        msg += body;
+    }
+
+    /* Take the frame at pos into body and advance pos; false if malformed */
+    inline bool get_frame(const string& msg, size_t& pos, string& body) {
+        size_t newline = msg.find('\n', pos);
+        if (newline == string::npos || newline == pos) { return false; }
+        size_t size = 0;
+        for (size_t i = pos; i < newline; ++i) {
+            if (msg[i] < '0' || msg[i] > '9') { return false; }
+            size = size * 10 + (msg[i] - '0');
+        }
+        if (size > msg.size() - newline - 1) { return false; }
+        body.assign(msg, newline + 1, size);
+        pos = newline + 1 + size;
+        return true;
+    }
+
+    inline bool write_all(int fd, const string& msg) {
+        size_t done = 0;
+        while (done < msg.size()) {
+            ssize_t n = send(fd, msg.data() + done, msg.size() - done, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n <= 0) { return false; }
+            done += n;
+        }
+        return true;
+    }
+
+    /* Limits the server puts on a request: its size in bytes, and how
+     * long it waits for more of it before giving up on the client.
+     */
+    const size_t MAX_REQUEST = 64 * 1024 * 1024;
+    const int REQUEST_TIMEOUT = 30;  // Seconds
+
+    /* Read until the other side shuts down its end of the connection;
+     * false on error (including a receive timeout) or past max bytes.
+     */
+    inline bool read_all(int fd, string& msg, size_t max = string::npos) {
+        char chunk[64 * 1024];
+        for (;;) {
+            ssize_t n = read(fd, chunk, sizeof chunk);
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n < 0) { return false; }
+            if (n == 0) { return true; }
+            if (static_cast<size_t>(n) > max - msg.size()) { return false; }
+            msg.append(chunk, n);
+        }
+    }
+
+    /* Make reads on fd fail after seconds with nothing to read */
+    inline bool set_read_timeout(int fd, int seconds) {
+        struct timeval tv;
+        tv.tv_sec = seconds;
+        tv.tv_usec = 0;
+        return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv) == 0;
+    }
+
+    /* Returns false with errno set if the path doesn't fit in an address */
+    inline bool socket_address(const string& path, sockaddr_un& addr) {
+        memset(&addr, 0, sizeof addr);
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof addr.sun_path) {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    /* Connected socket, or -1 with errno set */
+    inline int connect_to(const string& path) {
+        sockaddr_un addr;
+        if (!socket_address(path, addr)) { return -1; }
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) { return -1; }
+        if (connect(fd, (sockaddr*) &addr, sizeof addr) < 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        return fd;
+    }
+
+    /* Listening socket, or -1 with errno set.  A stale socket file left
+     * by a server that is no longer running is replaced.
+     */
+    inline int listen_on(const string& path) {
+        sockaddr_un addr;
+        if (!socket_address(path, addr)) { return -1; }
+        int probe = connect_to(path);
+        if (probe >= 0) {
+            close(probe);
+            errno = EADDRINUSE;
+            return -1;
+        }
+        unlink(path.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) { return -1; }
+        if (bind(fd, (sockaddr*) &addr, sizeof addr) < 0 || listen(fd, SOMAXCONN) < 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        return fd;
+    }
+}
+
+#endif //AST_PROTOCOL_H
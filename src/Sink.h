@@ -0,0 +1,56 @@
+//
+// Where generated C is assembled.
+//
+// A Sink appends to one growable buffer, and the compilation hands the
+// buffer over whole when it is done (take), so the C is written out
+// once rather than a line and a flush at a time.  Pieces are appended
+// as they are, without building temporary strings to join them.
+//
+
+#ifndef AST_SINK_H
+#define AST_SINK_H
+
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <utility>
+#include "Symbol.h"
+#include "Source.h"
+
+using namespace std;
+
+class Sink {
+    string buf_;
+public:
+    Sink() { buf_.reserve(4096); }
+    Sink(const Sink&) = delete;
+    Sink& operator=(const Sink&) = delete;
+
+    void append(const char* s, size_t len) { buf_.append(s, len); }
+
+    Sink& operator<<(const char* s) { buf_.append(s, strlen(s)); return *this; }
+    Sink& operator<<(const string& s) { buf_.append(s); return *this; }
+    Sink& operator<<(Symbol s) { buf_.append(s.str()); return *this; }
+    Sink& operator<<(const TextRef& text) { buf_.append(text.data, text.size); return *this; }
+    Sink& operator<<(char c) { buf_.push_back(c); return *this; }
+    Sink& operator<<(long n) {
+        char digits[24];
+        int len = snprintf(digits, sizeof digits, "%ld", n);
+        buf_.append(digits, len);
+        return *this;
+    }
+    Sink& operator<<(int n) { return *this << (long) n; }
+    Sink& operator<<(const Sink& other) { buf_.append(other.buf_); return *this; }
+
+    size_t size() const { return buf_.size(); }
+    const string& str() const { return buf_; }
+
+    /* The text so far; the sink is left empty */
+    string take() {
+        string text = std::move(buf_);
+        buf_.clear();
+        return text;
+    }
+};
+
+#endif //AST_SINK_H
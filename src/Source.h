@@ -0,0 +1,140 @@
+//
+// Source text for the scanner.
+//
+// A source file is mapped into memory once and scanned in place.
+// Tokens whose value is text (string literals) carry spans into
+// the mapped buffer instead of copies; the text is only copied when
+// a literal contains escapes that must be translated.
+//
+
+#ifndef AST_SOURCE_H
+#define AST_SOURCE_H
+
+#include <string>
+#include <ostream>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Arena.h"
+
+using namespace std;
+
+/* Location of a token's text in the source buffer */
+struct Span {
+    unsigned offset;
+    unsigned length;
+    bool escaped;     // Contains backslash escapes to be translated
+};
+
+/* Text that lives elsewhere (source buffer or arena), not NUL-terminated */
+struct TextRef {
+    const char* data;
+    size_t size;
+
+    string str() const { return string(data, size); }
+};
+
+inline ostream& operator<<(ostream& out, const TextRef& text) { return out.write(text.data, text.size); }
+
+class SourceBuffer {
+    string name_;
+    const char* data_ = "";
+    size_t size_ = 0;
+    bool mapped_ = false;
+    string copy_;         // Contents, when the input can't be mapped (pipes, terminals)
+
+public:
+    SourceBuffer() {}
+    ~SourceBuffer() { close(); }
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    /* Map the named file.  Returns false with errno set on failure. */
+    bool open(const string& path) {
+        close();
+        name_ = path;
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) { return false; }
+        struct stat info;
+        if (fstat(fd, &info) < 0) {
+            int saved = errno;
+            ::close(fd);
+            errno = saved;
+            return false;
+        }
+        if (S_ISREG(info.st_mode) && info.st_size > 0) {
+            void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                data_ = static_cast<const char*>(addr);
+                size_ = info.st_size;
+                mapped_ = true;
+                madvise(addr, size_, MADV_SEQUENTIAL);
+                ::close(fd);
+                return true;
+            }
+        }
+        // Not mappable: read it all
+        char chunk[64 * 1024];
+        ssize_t got;
+        while ((got = read(fd, chunk, sizeof chunk)) > 0) {
+            copy_.append(chunk, got);
+        }
+        int saved = errno;
+        ::close(fd);
+        if (got < 0) {
+            errno = saved;
+            return false;
+        }
+        data_ = copy_.data();
+        size_ = copy_.size();
+        return true;
+    }
+
+    /* Scan text already in memory (not copied; must outlive the buffer) */
+    void assign(const string& name, const char* text, size_t size) {
+        close();
+        name_ = name;
+        data_ = text;
+        size_ = size;
+    }
+
+    void close() {
+        if (mapped_) { munmap(const_cast<char*>(data_), size_); }
+        mapped_ = false;
+        copy_.clear();
+        data_ = "";
+        size_ = 0;
+    }
+
+    const string& name() const { return name_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    /* The value of a string literal.  Literals without escapes are returned
+     * in place; the others are translated into the arena.
+     */
+    TextRef literal(const Span& span, Arena& arena) const {
+        const char* text = data_ + span.offset;
+        if (!span.escaped) {
+            return TextRef{text, span.length};
+        }
+        char* out = static_cast<char*>(arena.alloc(span.length, 1));
+        size_t n = 0;
+        for (size_t i = 0; i < span.length; ++i) {
+            if (text[i] != '\\' || i + 1 == span.length) {
+                out[n++] = text[i];
+                continue;
+            }
+            switch (text[++i]) {
+                case 'n': out[n++] = '\n'; break;
+                case 't': out[n++] = '\t'; break;
+                default: break;  // Illegal escape, already reported by the scanner
+            }
+        }
+        return TextRef{out, n};
+    }
+};
+
+#endif //AST_SOURCE_H
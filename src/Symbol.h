@@ -0,0 +1,187 @@
+//
+// Interned identifiers.
+//
+// Every identifier, class name and method name is entered once into a
+// global table and thereafter handled as a 32-bit id.  Symbols compare
+// and order by id, so the symbol tables of the type checker and code
+// generator do integer comparisons rather than string comparisons.
+// The text is still available through str() for messages and output.
+//
+
+#ifndef AST_SYMBOL_H
+#define AST_SYMBOL_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <ostream>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+
+using namespace std;
+
+class Symbol {
+    uint32_t id_;
+    constexpr explicit Symbol(uint32_t id, int) : id_{id} {}
+public:
+    constexpr Symbol() : id_{0} {}   // The empty symbol ""
+    Symbol(const char* s) : Symbol(s, strlen(s)) {}
+    Symbol(const string& s) : Symbol(s.data(), s.size()) {}
+    Symbol(const char* s, size_t len);
+
+    static constexpr Symbol from_id(uint32_t id) { return Symbol(id, 0); }
+
+    constexpr uint32_t id() const { return id_; }
+    const string& str() const;
+    const char* c_str() const { return str().c_str(); }
+    bool empty() const { return id_ == 0; }
+
+    constexpr bool operator==(Symbol other) const { return id_ == other.id_; }
+    constexpr bool operator!=(Symbol other) const { return id_ != other.id_; }
+    constexpr bool operator<(Symbol other) const { return id_ < other.id_; }
+};
+
+/* Symbols the compiler itself refers to are interned first, in this
+ * order, so that their ids are compile-time constants.
+ */
+namespace sym {
+    constexpr Symbol empty = Symbol::from_id(0);
+    constexpr Symbol Obj = Symbol::from_id(1);
+    constexpr Symbol Int = Symbol::from_id(2);
+    constexpr Symbol String = Symbol::from_id(3);
+    constexpr Symbol Boolean = Symbol::from_id(4);
+    constexpr Symbol Nothing = Symbol::from_id(5);
+    constexpr Symbol this_ = Symbol::from_id(6);
+    constexpr Symbol pgm = Symbol::from_id(7);
+    constexpr Symbol constructor = Symbol::from_id(8);
+    constexpr Symbol Bottom = Symbol::from_id(9);
+    constexpr Symbol TypeError = Symbol::from_id(10);
+}
+
+/* The table is shared by every compilation in the process.  Interning
+ * takes a lock; looking up the text of a symbol does not, because names
+ * are stored in fixed chunks that never move once an id is handed out.
+ *
+ * Symbols are never freed: ids are baked into cached classes and may be
+ * held by other threads' compilations, so there is no point at which a
+ * name is known to be dead.  A long-running server therefore grows by
+ * the distinct names it has seen; bytes() is what --mem-report shows.
+ */
+class SymbolTable {
+    static const size_t CHUNK_BITS = 12;
+    static const size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+    static const size_t MAX_CHUNKS = size_t(1) << 14;   // 64M symbols
+
+    mutex lock;
+    unordered_map<string, uint32_t> ids;
+    // Keys of ids (which do not move on rehash), by id
+    atomic<const string**> chunks[MAX_CHUNKS];
+    uint32_t count = 0;
+    size_t text_bytes = 0;
+
+    SymbolTable() {
+        for (atomic<const string**>& chunk: chunks) { chunk.store(nullptr, memory_order_relaxed); }
+        static const char* const well_known[] = {
+            "", "Obj", "Int", "String", "Boolean", "Nothing", "this", "__pgm__",
+            "constructor", "Bottom", "TypeError"
+        };
+        for (const char* name: well_known) { intern(name, strlen(name)); }
+    }
+    ~SymbolTable() {
+        for (atomic<const string**>& chunk: chunks) { delete[] chunk.load(memory_order_relaxed); }
+    }
+public:
+    static SymbolTable& instance() {
+        static SymbolTable table;
+        return table;
+    }
+
+    uint32_t intern(const char* s, size_t len) {
+        lock_guard<mutex> guard(lock);
+        pair<unordered_map<string, uint32_t>::iterator, bool> entry =
+            ids.insert(make_pair(string(s, len), count));
+        if (entry.second) {
+            size_t chunk = count >> CHUNK_BITS;
+            if (chunk >= MAX_CHUNKS) {
+                throw length_error("too many symbols");
+            }
+            const string** names = chunks[chunk].load(memory_order_relaxed);
+            if (names == nullptr) {
+                names = new const string*[CHUNK_SIZE];
+                chunks[chunk].store(names, memory_order_release);
+            }
+            names[count & (CHUNK_SIZE - 1)] = &entry.first->first;
+            ++count;
+            text_bytes += len;
+        }
+        return entry.first->second;
+    }
+
+    const string& name(uint32_t id) const {
+        return *chunks[id >> CHUNK_BITS].load(memory_order_acquire)[id & (CHUNK_SIZE - 1)];
+    }
+    size_t size() {
+        lock_guard<mutex> guard(lock);
+        return count;
+    }
+    /* Roughly what the table holds on to: the names, their map entries and the chunks */
+    size_t bytes() {
+        lock_guard<mutex> guard(lock);
+        size_t chunks_used = (count + CHUNK_SIZE - 1) >> CHUNK_BITS;
+        return text_bytes
+               + count * (sizeof(pair<const string, uint32_t>) + 2 * sizeof(void*))
+               + ids.bucket_count() * sizeof(void*)
+               + chunks_used * CHUNK_SIZE * sizeof(const string*);
+    }
+};
+
+inline Symbol::Symbol(const char* s, size_t len) : id_{SymbolTable::instance().intern(s, len)} {}
+
+inline const string& Symbol::str() const { return SymbolTable::instance().name(id_); }
+
+inline ostream& operator<<(ostream& out, Symbol s) { return out << s.str(); }
+
+/* Generated code and messages splice symbols into strings */
+inline string operator+(const string& a, Symbol b) { return a + b.str(); }
+inline string operator+(Symbol a, const string& b) { return a.str() + b; }
+inline string operator+(const char* a, Symbol b) { return a + b.str(); }
+inline string operator+(Symbol a, const char* b) { return a.str() + b; }
+
+/* Symbols order by id, and ids depend on what the process happened to
+ * intern first.  Anything whose order shows in the compiler's output is
+ * listed by name instead, so it comes out the same in every compilation.
+ */
+template<class Table>
+vector<typename Table::iterator> by_name(Table& table) {
+    vector<typename Table::iterator> entries;
+    for (typename Table::iterator iter = table.begin(); iter != table.end(); ++iter) {
+        entries.push_back(iter);
+    }
+    sort(entries.begin(), entries.end(),
+         [](typename Table::iterator a, typename Table::iterator b) { return a->first.str() < b->first.str(); });
+    return entries;
+}
+
+template<class Table>
+vector<typename Table::const_iterator> by_name(const Table& table) {
+    vector<typename Table::const_iterator> entries;
+    for (typename Table::const_iterator iter = table.begin(); iter != table.end(); ++iter) {
+        entries.push_back(iter);
+    }
+    sort(entries.begin(), entries.end(),
+         [](typename Table::const_iterator a, typename Table::const_iterator b) { return a->first.str() < b->first.str(); });
+    return entries;
+}
+
+namespace std {
+    template<> struct hash<Symbol> {
+        size_t operator()(Symbol s) const { return s.id(); }
+    };
+}
+
+#endif //AST_SYMBOL_H
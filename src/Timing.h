@@ -0,0 +1,90 @@
+//
+// Where a compilation's time goes (parser --time-report).
+//
+// The compiler marks the end of each phase with Timings::lap, which
+// charges the wall clock and CPU time since the previous lap to that
+// phase.  CPU time is the calling thread's, so compilations running
+// side by side (-j, --server) don't count each other's work.  A lap
+// also charges the heap allocations counted since the last one (see
+// Memory.h) to its phase.
+//
+
+#ifndef AST_TIMING_H
+#define AST_TIMING_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ctime>
+
+#include "Memory.h"
+
+using namespace std;
+
+struct TimedPhase {
+    string name;
+    double wall_ms = 0;
+    double cpu_ms = 0;
+    long allocations = 0;
+    size_t bytes = 0;   // Asked for by those allocations
+};
+
+class Timer {
+    chrono::steady_clock::time_point wall_;
+    double cpu_;
+    memory::Tally tally_;
+public:
+    Timer() : wall_{chrono::steady_clock::now()}, cpu_{cpu_now()}, tally_(memory::tally()) {}
+
+    /* CPU time used by this thread so far */
+    static double cpu_now() {
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+    }
+
+    double wall_ms() const {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - wall_).count();
+    }
+    double cpu_ms() const { return cpu_now() - cpu_; }
+    long allocations() const { return memory::tally().allocations - tally_.allocations; }
+    size_t bytes() const { return memory::tally().bytes - tally_.bytes; }
+};
+
+class Timings {
+    vector<TimedPhase> phases_;  // In the order they first ran
+    Timer since_;                // The last lap
+public:
+    /* Charge the time since the last lap to phase (a phase may run in
+     * several pieces; they add up) */
+    void lap(const string& phase) {
+        add(phase, since_.wall_ms(), since_.cpu_ms(), since_.allocations(), since_.bytes());
+        since_ = Timer();
+    }
+
+    /* Start the next lap now, charging the time since the last to nothing */
+    void skip() { since_ = Timer(); }
+
+    void add(const string& phase, double wall_ms, double cpu_ms, long allocations = 0, size_t bytes = 0) {
+        for (TimedPhase& p: phases_) {
+            if (p.name == phase) {
+                p.wall_ms += wall_ms;
+                p.cpu_ms += cpu_ms;
+                p.allocations += allocations;
+                p.bytes += bytes;
+                return;
+            }
+        }
+        TimedPhase p;
+        p.name = phase;
+        p.wall_ms = wall_ms;
+        p.cpu_ms = cpu_ms;
+        p.allocations = allocations;
+        p.bytes = bytes;
+        phases_.push_back(p);
+    }
+
+    const vector<TimedPhase>& phases() const { return phases_; }
+};
+
+#endif //AST_TIMING_H
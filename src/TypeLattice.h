@@ -0,0 +1,134 @@
+//
+// The class hierarchy as a lattice of dense integer type ids.
+//
+// Once the hierarchy is known to be a tree rooted at Obj, each class
+// gets an id, parents before their children, and one depth-first walk
+// numbers the tree.  A class is a subtype of another exactly when its
+// pre/post-order interval lies inside the other's, so a subtype test is
+// two comparisons.  The least common ancestor of two classes is the
+// shallowest class the walk passes through between them, which a
+// sparse table over the walk finds with two lookups.
+//
+// Bottom is below every class: it is the type of a variable nothing
+// has been assigned to yet, and its join with any type is that type.
+// TypeError joins the same way, so that one bad expression doesn't
+// turn the types of everything it meets into Obj.
+//
+
+#ifndef AST_TYPELATTICE_H
+#define AST_TYPELATTICE_H
+
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include "Symbol.h"
+
+using namespace std;
+
+class TypeLattice {
+    vector<Symbol> types_;             // By id
+    vector<int> parent_;               // Id of the parent; -1 for the root
+    vector<int> depth_;
+    vector<int> pre_, post_;           // Where the walk enters and leaves each class
+    vector<int> first_;                // Where each class first appears in walk_
+    vector<int> walk_;                 // Ids in the order the walk passes through them
+    vector<vector<int>> shallowest_;   // [k][i]: shallowest class in walk_[i, i + 2^k)
+    unordered_map<Symbol, int> ids_;
+
+    int shallower(int a, int b) const { return depth_[a] <= depth_[b] ? a : b; }
+
+public:
+    static const int NONE = -1;      // Not a class
+    static const int BOTTOM = -2;    // Bottom or TypeError
+
+    /* The hierarchy as (class, parent) pairs, each parent before its
+     * children; the first is the root.  Any earlier hierarchy is forgotten.
+     */
+    void build(const vector<pair<Symbol, Symbol>>& classes) {
+        size_t n = classes.size();
+        types_.assign(n, Symbol());
+        parent_.assign(n, -1);
+        depth_.assign(n, 0);
+        ids_.clear();
+        ids_.reserve(n);
+        vector<vector<int>> children(n);
+        for (size_t i = 0; i < n; ++i) {
+            types_[i] = classes[i].first;
+            ids_[classes[i].first] = (int) i;
+            if (i == 0) { continue; }
+            int parent = ids_.at(classes[i].second);
+            parent_[i] = parent;
+            depth_[i] = depth_[parent] + 1;
+            children[parent].push_back((int) i);
+        }
+
+        // The walk, with an explicit stack of (class, next child)
+        pre_.assign(n, 0);
+        post_.assign(n, 0);
+        first_.assign(n, 0);
+        walk_.clear();
+        walk_.reserve(n == 0 ? 0 : 2 * n - 1);
+        int clock = 0;
+        vector<pair<int, size_t>> stack;
+        if (n > 0) { stack.push_back(make_pair(0, (size_t) 0)); }
+        while (!stack.empty()) {
+            int id = stack.back().first;
+            size_t& next = stack.back().second;
+            if (next == 0) {
+                pre_[id] = clock++;
+                first_[id] = (int) walk_.size();
+            }
+            walk_.push_back(id);
+            if (next < children[id].size()) {
+                int child = children[id][next++];
+                stack.push_back(make_pair(child, (size_t) 0));
+            }
+            else {
+                post_[id] = clock++;
+                stack.pop_back();
+            }
+        }
+
+        shallowest_.assign(1, walk_);
+        for (size_t width = 2; width <= walk_.size(); width *= 2) {
+            const vector<int>& half = shallowest_.back();
+            vector<int> level(walk_.size() - width + 1);
+            for (size_t i = 0; i < level.size(); ++i) {
+                level[i] = shallower(half[i], half[i + width / 2]);
+            }
+            shallowest_.push_back(std::move(level));
+        }
+    }
+
+    size_t size() const { return types_.size(); }
+
+    /* The id of type: BOTTOM for Bottom and TypeError, NONE if it isn't a class */
+    int id(Symbol type) const {
+        if (type == sym::Bottom || type == sym::TypeError) { return BOTTOM; }
+        unordered_map<Symbol, int>::const_iterator it = ids_.find(type);
+        return it == ids_.end() ? NONE : it->second;
+    }
+
+    Symbol type(int id) const { return id == BOTTOM ? sym::Bottom : types_[id]; }
+    int parent(int id) const { return parent_[id]; }
+    int depth(int id) const { return depth_[id]; }
+
+    /* Is class sub the same as class super or below it? */
+    bool is_subtype(int sub, int super) const {
+        return pre_[super] <= pre_[sub] && post_[sub] <= post_[super];
+    }
+
+    /* The least upper bound of a and b, classes or BOTTOM */
+    int join(int a, int b) const {
+        if (a == BOTTOM) { return b; }
+        if (b == BOTTOM) { return a; }
+        if (is_subtype(a, b)) { return b; }
+        if (is_subtype(b, a)) { return a; }
+        int from = first_[a], to = first_[b];
+        if (from > to) { swap(from, to); }
+        int level = 31 - __builtin_clz((unsigned) (to - from + 1));   // Two overlapping spans cover it
+        return shallower(shallowest_[level][from], shallowest_[level][to - (1 << level) + 1]);
+    }
+};
+
+#endif //AST_TYPELATTICE_H
@@ -0,0 +1,137 @@
+//
+// Variable environments for type inference.
+//
+// The variables of a method (or constructor, or the main program) live
+// in one flat array, in the order they were first assigned, so each has
+// a fixed slot.  A small open-addressed index takes names to slots, so
+// looking a variable up or changing its type allocates nothing; only
+// adding one may grow the arrays.  Iteration is in slot order, which is
+// the same in every run.
+//
+// Scopes nest.  push_scope marks the environment and pop_scope undoes
+// everything set since, types changed and variables added, so a
+// typecase arm binds its identifier and checks its statements without
+// copying the table.
+//
+
+#ifndef AST_VARENV_H
+#define AST_VARENV_H
+
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstdint>
+#include "Symbol.h"
+
+using namespace std;
+
+class VarEnv {
+public:
+    typedef pair<Symbol, Symbol> Var;                 // Name and type
+    typedef vector<Var>::iterator iterator;
+    typedef vector<Var>::const_iterator const_iterator;
+
+private:
+    vector<Var> vars_;                                // By slot
+    vector<int32_t> index_;                           // Slot + 1, by hash of the name; 0 = empty
+    struct Undo { int32_t slot; Symbol type; };       // A slot's type before a set in a scope
+    vector<Undo> trail_;
+    struct Mark { size_t vars, trail; };
+    vector<Mark> scopes_;
+
+    size_t mask() const { return index_.size() - 1; }
+    size_t home(Symbol name) const { return (name.id() * 0x9E3779B1u) & mask(); }
+
+    void index(int32_t slot) {
+        size_t i = home(vars_[slot].first);
+        while (index_[i] != 0) { i = (i + 1) & mask(); }
+        index_[i] = slot + 1;
+    }
+
+    /* Drop the last slot from the index.  Every other name was indexed
+     * before it, so no probe for one of them passes over its entry.
+     */
+    void unindex_last() {
+        size_t i = home(vars_.back().first);
+        while (index_[i] != (int32_t) vars_.size()) { i = (i + 1) & mask(); }
+        index_[i] = 0;
+    }
+
+    void add(Symbol name, Symbol type) {
+        if (2 * (vars_.size() + 1) > index_.size()) {
+            index_.assign(index_.empty() ? 16 : 2 * index_.size(), 0);
+            for (int32_t slot = 0; slot < (int32_t) vars_.size(); ++slot) { index(slot); }
+        }
+        vars_.push_back(Var(name, type));
+        index((int32_t) vars_.size() - 1);
+    }
+
+public:
+    /* The slot of the variable name, or -1 if there is none */
+    int slot(Symbol name) const {
+        if (index_.empty()) { return -1; }
+        for (size_t i = home(name); index_[i] != 0; i = (i + 1) & mask()) {
+            if (vars_[index_[i] - 1].first == name) { return index_[i] - 1; }
+        }
+        return -1;
+    }
+
+    size_t count(Symbol name) const { return slot(name) >= 0 ? 1 : 0; }
+
+    /* The type of name, or the empty symbol if it has none */
+    Symbol get(Symbol name) const {
+        int s = slot(name);
+        return s >= 0 ? vars_[s].second : Symbol();
+    }
+
+    Symbol type(int slot) const { return vars_[slot].second; }
+
+    /* Give name the type type, adding it if it is new */
+    void set(Symbol name, Symbol type) {
+        int s = slot(name);
+        if (s < 0) {
+            add(name, type);
+            return;
+        }
+        if (vars_[s].second == type) { return; }
+        if (!scopes_.empty()) { trail_.push_back(Undo{s, vars_[s].second}); }
+        vars_[s].second = type;
+    }
+
+    void push_scope() { scopes_.push_back(Mark{vars_.size(), trail_.size()}); }
+
+    /* Undo everything set since the matching push_scope */
+    void pop_scope() {
+        Mark mark = scopes_.back();
+        scopes_.pop_back();
+        while (trail_.size() > mark.trail) {
+            vars_[trail_.back().slot].second = trail_.back().type;
+            trail_.pop_back();
+        }
+        while (vars_.size() > mark.vars) {
+            unindex_last();
+            vars_.pop_back();
+        }
+    }
+
+    size_t size() const { return vars_.size(); }
+    bool empty() const { return vars_.empty(); }
+    iterator begin() { return vars_.begin(); }
+    iterator end() { return vars_.end(); }
+    const_iterator begin() const { return vars_.begin(); }
+    const_iterator end() const { return vars_.end(); }
+
+    /* The variables as a table, and back (for the class cache) */
+    map<Symbol, Symbol> to_map() const { return map<Symbol, Symbol>(vars_.begin(), vars_.end()); }
+    void assign(const map<Symbol, Symbol>& table) {
+        vars_.clear();
+        index_.clear();
+        trail_.clear();
+        scopes_.clear();
+        for (map<Symbol, Symbol>::const_iterator iter = table.begin(); iter != table.end(); ++iter) {
+            add(iter->first, iter->second);
+        }
+    }
+};
+
+#endif //AST_VARENV_H
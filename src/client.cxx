@@ -0,0 +1,180 @@
+//
+// Client for the compile server (parser --server SOCKET).
+//
+//    quack-client [-o out.c] SOCKET file.qk
+//        Compile file.qk on the server.  Prints what the compiler
+//        printed and writes the C to out.c (default quackmain.c),
+//        just as bin/parser would.
+//
+//    quack-client -b N [-p bin/parser] SOCKET file.qk
+//        Latency benchmark: compile file.qk N times by starting a
+//        fresh compiler process each time (cold), then N times
+//        through the server (warm), and compare.
+//
+
+#include "Protocol.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+struct Reply {
+    int status = 1;
+    std::string out, err, code;
+};
+
+/* Send one compile request; false (with a message on cerr) if the server can't be reached */
+bool request(const std::string& socket_path, const std::string& name, const std::string& text, Reply& reply) {
+    int fd = protocol::connect_to(socket_path);
+    if (fd < 0) {
+        std::cerr << socket_path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    std::string msg, response, status;
+    protocol::put_frame(msg, name);
+    protocol::put_frame(msg, text);
+    bool ok = protocol::write_all(fd, msg) && shutdown(fd, SHUT_WR) == 0
+              && protocol::read_all(fd, response);
+    close(fd);
+    size_t pos = 0;
+    if (!ok || !protocol::get_frame(response, pos, status)
+            || !protocol::get_frame(response, pos, reply.out)
+            || !protocol::get_frame(response, pos, reply.err)
+            || !protocol::get_frame(response, pos, reply.code)) {
+        std::cerr << socket_path << ": bad reply from server" << std::endl;
+        return false;
+    }
+    reply.status = atoi(status.c_str());
+    return true;
+}
+
+/* Run the compiler once as a new process, in dir; returns false if it could not be started */
+bool run_cold(const char* parser, const char* input, const char* dir) {
+    pid_t pid = fork();
+    if (pid < 0) { return false; }
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, 1);
+        dup2(devnull, 2);
+        if (chdir(dir) < 0) { _exit(127); }  // It writes quackmain.c
+        execl(parser, parser, input, (char*) nullptr);
+        _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) != 127;
+}
+
+void summarize(const char* label, std::vector<double>& ms) {
+    std::sort(ms.begin(), ms.end());
+    double total = 0;
+    for (double t: ms) { total += t; }
+    std::cout << label << ms.size() << " runs, mean " << total / ms.size()
+              << " ms, median " << ms[ms.size() / 2] << " ms, min " << ms.front() << " ms" << std::endl;
+}
+
+int benchmark(int runs, const char* parser, const std::string& socket_path,
+              const char* input, const std::string& text) {
+    typedef std::chrono::steady_clock clock;
+    char parser_path[PATH_MAX], input_path[PATH_MAX];
+    if (realpath(parser, parser_path) == nullptr) {
+        std::cerr << parser << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    if (realpath(input, input_path) == nullptr) {
+        std::cerr << input << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    char dir[] = "/tmp/quack-bench-XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        std::cerr << "mkdtemp: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::vector<double> cold, warm;
+    for (int i = 0; i < runs; ++i) {
+        clock::time_point start = clock::now();
+        if (!run_cold(parser_path, input_path, dir)) {
+            std::cerr << parser << ": could not run" << std::endl;
+            break;
+        }
+        cold.push_back(std::chrono::duration<double, std::milli>(clock::now() - start).count());
+    }
+    unlink((std::string(dir) + "/quackmain.c").c_str());
+    rmdir(dir);
+
+    for (int i = 0; i < runs; ++i) {
+        Reply reply;
+        clock::time_point start = clock::now();
+        if (!request(socket_path, input, text, reply)) { break; }
+        warm.push_back(std::chrono::duration<double, std::milli>(clock::now() - start).count());
+    }
+
+    if (cold.empty() || warm.empty()) { return 1; }
+    std::cout << input << ":" << std::endl;
+    summarize("  cold (new process):   ", cold);
+    summarize("  warm (server request): ", warm);
+    std::cout << "  median speedup " << cold[cold.size() / 2] / warm[warm.size() / 2] << "x" << std::endl;
+    return 0;
+}
+
+void usage() {
+    std::cerr << "usage: quack-client [-o out.c] SOCKET file.qk" << std::endl;
+    std::cerr << "       quack-client -b N [-p parser] SOCKET file.qk" << std::endl;
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int c;
+    const char* outpath = "quackmain.c";
+    const char* parser = "bin/parser";
+    int runs = 0; // Benchmark runs; 0 = just compile
+
+    while ((c = getopt(argc, argv, "o:b:p:")) != -1) {
+        if (c == 'o') {
+            outpath = optarg;
+        } else if (c == 'b') {
+            runs = atoi(optarg);
+            if (runs < 1) { usage(); }
+        } else if (c == 'p') {
+            parser = optarg;
+        } else {
+            usage();
+        }
+    }
+    if (argc - optind != 2) { usage(); }
+    std::string socket_path = argv[optind];
+    const char* input = argv[optind + 1];
+
+    std::ifstream infile(input, std::ios::binary);
+    if (!infile) {
+        std::cerr << input << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    std::ostringstream text;
+    text << infile.rdbuf();
+
+    if (runs > 0) {
+        return benchmark(runs, parser, socket_path, input, text.str());
+    }
+
+    Reply reply;
+    if (!request(socket_path, input, text.str(), reply)) { return 1; }
+    std::cout << reply.out << std::flush;
+    std::cerr << reply.err << std::flush;
+    if (!reply.code.empty()) {
+        std::ofstream outfile(outpath);
+        outfile << reply.code;
+    }
+    return reply.status;
+}
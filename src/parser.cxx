@@ -1,105 +1,516 @@
 //
-// The parser driver just glues together a parser object
-// and a lexer object.
+// The compiler's command line.  The compiling itself is done by
+// libquack (Compiler.h); this reads the inputs, writes the C, and
+// prints what the compiler had to say.
 //
 
-#include "lex.yy.h"
-#include "ASTNode.h"
-#include "Messages.h"
-#include "staticsemantics.cxx"
-#include "CodegenContext.h"
+#include "Compiler.h"
+#include "Source.h"
+#include "Protocol.h"
+#include "Timing.h"
+#include "Memory.h"
 
 #include <iostream>
 #include <fstream>
-#include <unistd.h>  // getopt is here
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <csignal>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <getopt.h>  // getopt_long is here
 
-class Driver {
-    int debug_level = 0;
+/* The class cache (--cache DIR): one file per entry, named by its key.
+ * An entry is written to a file of its own and renamed into place, so
+ * compilers sharing the directory never see a partial entry.
+ */
+class DirectoryCache : public quack::ClassCache {
+    std::string dir_;
+    std::atomic<unsigned long> next_temp_{0};
 public:
-    explicit Driver(const reflex::Input in) : lexer(in), parser(new yy::parser(lexer, &root)) { root = nullptr; }
+    explicit DirectoryCache(const std::string& dir) : dir_{dir} {}
 
-    ~Driver() { delete parser; }
+    bool open() {
+        return mkdir(dir_.c_str(), 0777) == 0 || errno == EEXIST;
+    }
 
-    void debug() { debug_level = 1; }
+    bool load(const std::string& key, std::string& entry) override {
+        std::ifstream file(dir_ + "/" + key, std::ios::binary);
+        if (!file) { return false; }
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        entry = contents.str();
+        return true;
+    }
 
-    AST::ASTNode *parse() {
-        parser->set_debug_level(debug_level); // 0 = no debugging, 1 = full tracing
-        // std::cout << "Running parser\n";
-        int result = parser->parse();
-        if (result == 0 && report::ok()) {  // 0 == success, 1 == failure
-            // std::cout << "Extracting result\n";
-            if (root == nullptr) {
-                std::cout << "But I got a null result!  How?!\n";
+    void store(const std::string& key, const std::string& entry) override {
+        std::string path = dir_ + "/" + key;
+        std::string temp = path + "." + std::to_string(getpid()) + "." + std::to_string(next_temp_++) + ".tmp";
+        {
+            std::ofstream file(temp, std::ios::binary);
+            file << entry;
+            if (!file.flush()) {
+                unlink(temp.c_str());
+                return;  // Not cached; the next compilation just misses
             }
-            return root;
+        }
+        if (rename(temp.c_str(), path.c_str()) != 0) {
+            unlink(temp.c_str());
+        }
+    }
+};
+
+static bool cache_stats = false;  // --cache-stats
+
+/* "name: cache: 3 hits, 1 misses", for --cache-stats */
+std::string cache_report(const std::string& name, const quack::Stats& stats) {
+    return name + ": cache: " + std::to_string(stats.cache_hits) + " hits, "
+        + std::to_string(stats.cache_misses) + " misses\n";
+}
+
+enum ReportFormat { NO_REPORT, TABLE, JSON };
+static ReportFormat time_report = NO_REPORT;  // --time-report[=json]
+
+static std::string json_string(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c: text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof escape, "\\u%04x", c);
+            quoted += escape;
         } else {
-            // std::cout << "Parse failed, no tree\n";
-            return nullptr;
+            quoted += c;
         }
     }
+    return quoted + "\"";
+}
 
-private:
-    yy::Lexer lexer;
-    yy::parser *parser;
-    AST::ASTNode *root;
-};
+/* Phase times and counters for --time-report, as a table or as one
+ * line of JSON per input
+ */
+std::string time_report_for(const std::string& name, const quack::Stats& stats) {
+    char line[256];
+    std::string report;
+    double wall = 0, cpu = 0;
+    for (const quack::PhaseTime& phase: stats.phase_times) {
+        wall += phase.wall_ms;
+        cpu += phase.cpu_ms;
+    }
+    if (time_report == JSON) {
+        report = "{\"file\": " + json_string(name) + ", \"phases\": [";
+        for (size_t i = 0; i < stats.phase_times.size(); ++i) {
+            const quack::PhaseTime& phase = stats.phase_times[i];
+            snprintf(line, sizeof line, "%s{\"name\": %s, \"wall_ms\": %.3f, \"cpu_ms\": %.3f}",
+                     i > 0 ? ", " : "", json_string(phase.name).c_str(), phase.wall_ms, phase.cpu_ms);
+            report += line;
+        }
+        snprintf(line, sizeof line, "], \"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}, \"counters\": {", wall, cpu);
+        report += line;
+        for (size_t i = 0; i < stats.counters.size(); ++i) {
+            report += (i > 0 ? ", " : "") + json_string(stats.counters[i].first) + ": "
+                    + std::to_string(stats.counters[i].second);
+        }
+        return report + "}}\n";
+    }
+    report = name + ": time report\n";
+    snprintf(line, sizeof line, "  %-28s %12s %12s\n", "phase", "wall ms", "cpu ms");
+    report += line;
+    for (const quack::PhaseTime& phase: stats.phase_times) {
+        snprintf(line, sizeof line, "  %-28s %12.3f %12.3f\n", phase.name.c_str(), phase.wall_ms, phase.cpu_ms);
+        report += line;
+    }
+    snprintf(line, sizeof line, "  %-28s %12.3f %12.3f\n", "total", wall, cpu);
+    report += line;
+    snprintf(line, sizeof line, "  %-28s %12s\n", "counter", "count");
+    report += line;
+    for (const std::pair<std::string, long>& counter: stats.counters) {
+        snprintf(line, sizeof line, "  %-28s %12ld\n", counter.first.c_str(), counter.second);
+        report += line;
+    }
+    return report;
+}
+
+static bool mem_report = false;  // --mem-report
+static const size_t TOP_SITES = 10;
+
+/* Heap allocations by phase, peak RSS and the top allocation sites, for
+ * --mem-report.  Takes the sites the calling thread has recorded, so
+ * call it on the thread that did the compiling.
+ */
+std::string mem_report_for(const std::string& name, const quack::Stats& stats) {
+    char line[256];
+    long allocations = 0;
+    size_t bytes = 0;
+    std::string report = name + ": memory report\n";
+    snprintf(line, sizeof line, "  %-28s %12s %12s\n", "phase", "allocations", "bytes");
+    report += line;
+    for (const quack::PhaseTime& phase: stats.phase_times) {
+        snprintf(line, sizeof line, "  %-28s %12ld %12zu\n", phase.name.c_str(), phase.allocations, phase.bytes);
+        report += line;
+        allocations += phase.allocations;
+        bytes += phase.bytes;
+    }
+    snprintf(line, sizeof line, "  %-28s %12ld %12zu\n", "total", allocations, bytes);
+    report += line;
+    snprintf(line, sizeof line, "  %-28s %12s %12zu\n", "arena", "", stats.arena_bytes);
+    report += line;
+    snprintf(line, sizeof line, "  %-28s %12zu %12zu\n", "symbols (process)", stats.symbols, stats.symbol_bytes);
+    report += line;
+    snprintf(line, sizeof line, "  %-28s %12s %9ld KB\n", "peak RSS (process)", "", memory::peak_rss_kb());
+    report += line;
+    snprintf(line, sizeof line, "  %12s %12s  %s\n", "allocations", "bytes", "site");
+    report += line;
+    for (const memory::Site& site: memory::take_sites(TOP_SITES)) {
+        snprintf(line, sizeof line, "  %12ld %12zu  ", site.allocations, site.bytes);
+        report += line + site.function + "\n";
+    }
+    return report;
+}
+
+/* The Options::emit flags named in a --emit list such as "ast,c",
+ * or -1 if it names something else
+ */
+static int parse_emit(const char* list) {
+    static const std::pair<const char*, int> names[] = {
+        {"ast", quack::EMIT_AST}, {"hierarchy", quack::EMIT_HIERARCHY}, {"c", quack::EMIT_C}
+    };
+    int emit = 0;
+    std::istringstream items(list);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        int flag = 0;
+        for (const std::pair<const char*, int>& name: names) {
+            if (item == name.first) { flag = name.second; }
+        }
+        if (flag == 0) { return -1; }
+        emit |= flag;
+    }
+    return emit;
+}
+
+/* The exit status of a compilation: 1 if it reported errors.  A
+ * lex-only run generates no C, but that isn't a failure.
+ */
+static int exit_status(const quack::Result& result, const quack::Options& opts) {
+    return result.ok || opts.lex_only ? 0 : 1;
+}
+
+/* Compile one input file into outpath.  Returns 0, or 1 if the input
+ * could not be read or the compilation reported errors.
+ */
+int compile_file(const char* path, const std::string& outpath, const quack::Options& opts,
+                 std::ostream& out, std::ostream& err) {
+    SourceBuffer source;
+    if (!source.open(path)) {
+        err << path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    quack::Result result = quack::compile(source.data(), source.size(), path, opts);
+    out << result.output << std::flush;
+    err << result.diagnostics << std::flush;
+    if (cache_stats) {
+        err << cache_report(path, result.stats) << std::flush;
+    }
+    if (result.ok) {
+        memory::Counting counting(mem_report);
+        Timer writing;
+        {
+            std::ofstream outfile(outpath);
+            outfile << result.c_code;
+        }
+        quack::PhaseTime write;
+        write.name = "write";
+        write.wall_ms = writing.wall_ms();
+        write.cpu_ms = writing.cpu_ms();
+        write.allocations = writing.allocations();
+        write.bytes = writing.bytes();
+        result.stats.phase_times.push_back(write);
+    }
+    if (time_report != NO_REPORT) {
+        err << time_report_for(path, result.stats) << std::flush;
+    }
+    if (mem_report) {
+        err << mem_report_for(path, result.stats) << std::flush;
+    }
+    return exit_status(result, opts);
+}
+
+/* When there are several inputs, each one's C goes next to it: foo.qk -> foo.c */
+std::string output_path(const std::string& input) {
+    size_t dot = input.rfind('.');
+    size_t slash = input.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return input + ".c";
+    }
+    return input.substr(0, dot) + ".c";
+}
+
+/* Compile inputs on a pool of worker threads.  Each compilation's messages
+ * are collected separately and printed in input order, so the output is
+ * the same as compiling them one after another.
+ */
+int compile_parallel(const std::vector<const char*>& inputs, int jobs, const quack::Options& opts) {
+    struct Result {
+        std::ostringstream out;
+        std::ostringstream err;
+        int status = 0;
+        bool done = false;
+    };
+    std::vector<Result> results(inputs.size());
+    std::mutex lock;
+    std::condition_variable finished;
+    std::atomic<size_t> next(0);
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < jobs; ++i) {
+        pool.emplace_back([&]() {
+            size_t job;
+            while ((job = next++) < inputs.size()) {
+                Result& result = results[job];
+                int status = compile_file(inputs[job], output_path(inputs[job]), opts, result.out, result.err);
+                std::lock_guard<std::mutex> guard(lock);
+                result.status = status;
+                result.done = true;
+                finished.notify_all();
+            }
+        });
+    }
+
+    int status = 0;
+    for (Result& result: results) {
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [&]() { return result.done; });
+        guard.unlock();
+        std::cout << result.out.str() << std::flush;
+        std::cerr << result.err.str() << std::flush;
+        result.out.str("");
+        result.err.str("");
+        status |= result.status;
+    }
+    for (std::thread& worker: pool) {
+        worker.join();
+    }
+    return status;
+}
+
+/* Compile server.  The compiler stays resident and takes requests
+ * (see Protocol.h) on a Unix socket, so clients skip process startup
+ * and building the builtin classes.  Requests are independent of one
+ * another; each of the jobs worker threads serves one at a time.
+ * The symbol table is the one thing requests share that only grows:
+ * each distinct name any request uses stays interned for the life of
+ * the server (--mem-report shows how much that is).
+ */
+static int server_listener = -1;
+static volatile sig_atomic_t server_stopping = 0;
+
+/* SIGINT and SIGTERM shut the listening socket, which wakes the
+ * workers out of accept.  They finish the requests they have, and
+ * serve returns, so the server exits through the same teardown as any
+ * other compilation (which is what a leak checker sees).
+ */
+static void stop_server(int sig) {
+    (void) sig;
+    server_stopping = 1;
+    shutdown(server_listener, SHUT_RDWR);
+}
+
+void serve_connection(int fd, const quack::Options& opts) {
+    std::string request, reply, name, text;
+    size_t pos = 0;
+    if (!protocol::set_read_timeout(fd, protocol::REQUEST_TIMEOUT)
+            || !protocol::read_all(fd, request, protocol::MAX_REQUEST)
+            || !protocol::get_frame(request, pos, name)
+            || !protocol::get_frame(request, pos, text)) {
+        protocol::put_frame(reply, "1");
+        protocol::put_frame(reply, "");
+        protocol::put_frame(reply, "Malformed, oversized or incomplete compile request\n");
+        protocol::put_frame(reply, "");
+    } else {
+        quack::Result result;
+        int status = 0;
+        try {
+            result = quack::compile(text.data(), text.size(), name, opts);
+            status = exit_status(result, opts);
+        } catch (const std::exception& e) {
+            // Don't let one bad program take the server down
+            result = quack::Result();
+            result.diagnostics = name + ": internal compiler error: " + e.what() + "\n";
+            status = 1;
+        }
+        if (cache_stats) {
+            result.diagnostics += cache_report(name, result.stats);
+        }
+        if (time_report != NO_REPORT) {
+            result.diagnostics += time_report_for(name, result.stats);  // The client writes the C
+        }
+        if (mem_report) {
+            result.diagnostics += mem_report_for(name, result.stats);
+        }
+        protocol::put_frame(reply, std::to_string(status));
+        protocol::put_frame(reply, result.output);
+        protocol::put_frame(reply, result.diagnostics);
+        protocol::put_frame(reply, result.c_code);
+    }
+    protocol::write_all(fd, reply);
+    close(fd);
+}
 
-void generate_code(AST::ASTNode *root, StaticSemantics* ssc) {
-    AST::Program *astroot = (AST::Program*) root;
-    ofstream outfile;
-    outfile.open("quackmain.c");
-    //outfile << "Writing this to a file.\n";
-    Context ctx(outfile, ssc, "", "");
-    // Prologue
-    ctx.emit("#include <stdio.h>");
-    ctx.emit("#include \"Builtins.h\"");
-    ctx.emit("int main(int argc, char **argv) {");
-    // Body of generated code
-    std::string target = ctx.alloc_reg("Obj");
-    astroot->genR(&ctx, target);
-    // Coda
-    //ctx.emit(std::string(R"(printf("-> %d\n",)")
-    //    + target + ");");
-    ctx.emit("}");
-    outfile.close();
+int serve(const char* path, int jobs, const quack::Options& opts) {
+    if (strlen(path) >= sizeof(sockaddr_un::sun_path)) {
+        std::cerr << path << ": " << strerror(ENAMETOOLONG) << std::endl;
+        return 1;
+    }
+    int listener = protocol::listen_on(path);
+    if (listener < 0) {
+        std::cerr << path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    server_listener = listener;
+    signal(SIGINT, stop_server);
+    signal(SIGTERM, stop_server);
+    quack::prepare();  // Build the builtin classes now rather than in the first request
+    std::cerr << "Serving compile requests on " << path << std::endl;
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < jobs; ++i) {
+        pool.emplace_back([&]() {
+            for (;;) {
+                int fd = accept(listener, nullptr, nullptr);
+                if (server_stopping) {
+                    if (fd >= 0) { close(fd); }
+                    return;
+                }
+                if (fd < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) { continue; }
+                    std::cerr << path << ": " << strerror(errno) << std::endl;
+                    return;
+                }
+                serve_connection(fd, opts);
+            }
+        });
+    }
+    for (std::thread& worker: pool) {
+        worker.join();
+    }
+    close(listener);
+    unlink(path);
+    return server_stopping ? 0 : 1;
 }
 
 int main(int argc, char **argv) {
-    std::string filename;
-    char c;
-    FILE *f;
-    int index;
-    int debug; // 0 = no debugging, 1 = full tracing
+    int c;
+    quack::Options opts;
+    int jobs = 1; // Number of inputs to compile concurrently
+    const char* server = nullptr; // Socket to serve requests on, instead of compiling inputs
+    const char* cache_dir = nullptr; // Where to keep classes between compilations
 
-    while ((c = getopt(argc, argv, "t")) != -1) {
+    static const struct option long_options[] = {
+        {"server", required_argument, nullptr, 's'},
+        {"cache", required_argument, nullptr, 'C'},
+        {"cache-stats", no_argument, nullptr, 'S'},
+        {"time-report", optional_argument, nullptr, 'T'},
+        {"mem-report", no_argument, nullptr, 'M'},
+        {"emit", required_argument, nullptr, 'E'},
+        {"check-threads", required_argument, nullptr, 'K'},
+        {nullptr, 0, nullptr, 0}
+    };
+    while ((c = getopt_long(argc, argv, "tmlj:", long_options, nullptr)) != -1) {
         if (c == 't') {
             std::cerr <<  "Debugging mode\n";
-            debug = 1;
+            opts.debug = 1;
+        }
+        if (c == 'm') {
+            opts.arena_stats = 1;
+        }
+        if (c == 'l') {
+            opts.lex_only = 1;
+        }
+        if (c == 'j') {
+            jobs = atoi(optarg);
+            if (jobs < 1) {
+                std::cerr << "-j needs a positive number of jobs" << std::endl;
+                exit(1);
+            }
+        }
+        if (c == 's') {
+            server = optarg;
+        }
+        if (c == 'C') {
+            cache_dir = optarg;
+        }
+        if (c == 'S') {
+            cache_stats = true;
+        }
+        if (c == 'T') {
+            if (optarg == nullptr || strcmp(optarg, "table") == 0) {
+                time_report = TABLE;
+            } else if (strcmp(optarg, "json") == 0) {
+                time_report = JSON;
+            } else {
+                std::cerr << "--time-report is --time-report=table or --time-report=json" << std::endl;
+                exit(1);
+            }
+            opts.time_report = 1;
+        }
+        if (c == 'E') {
+            int emit = parse_emit(optarg);
+            if (emit < 0) {
+                std::cerr << "--emit is a comma-separated list of ast, hierarchy and c" << std::endl;
+                exit(1);
+            }
+            opts.emit |= emit;
+        }
+        if (c == 'K') {
+            opts.check_threads = atoi(optarg);
+            if (opts.check_threads < 1) {
+                std::cerr << "--check-threads needs a positive number of threads" << std::endl;
+                exit(1);
+            }
+        }
+        if (c == 'M') {
+            mem_report = true;
+            opts.mem_report = 1;
         }
     }
 
-    for (index = optind; index < argc; ++index) {
-        if( !(f = fopen(argv[index], "r"))) {
-            perror(argv[index]);
+    DirectoryCache cache(cache_dir != nullptr ? cache_dir : "");
+    if (cache_dir != nullptr) {
+        if (!cache.open()) {
+            std::cerr << cache_dir << ": " << strerror(errno) << std::endl;
             exit(1);
         }
-        Driver driver(f);
-        if (debug) driver.debug();
-        AST::ASTNode *root = driver.parse();
-        if (root != nullptr) {
-            // std::cout << "Parsed!\n";
-            AST::AST_print_context context;
-            root->json(std::cout, context);
-            std::cout << std::endl;
-            // STATIC SEMANTIC CHECK ON TREE
-            // return (or null pointer if error)
-            StaticSemantics semanticChecker(root);
-            semanticChecker.checkAST();
-            AST::Program *astroot = (AST::Program*) root;
-            generate_code(astroot, &semanticChecker);
-        } else {
-            std::cout << "No tree produced." << std::endl;
-        }
+        opts.cache = &cache;
     }
 
+    std::vector<const char*> inputs(argv + optind, argv + argc);
+    if (server != nullptr) {
+        if (!inputs.empty()) {
+            std::cerr << "--server takes no input files" << std::endl;
+            exit(1);
+        }
+        return serve(server, jobs, opts);
+    }
+    if (jobs > (int) inputs.size()) {
+        jobs = inputs.size();
+    }
+    if (jobs > 1) {
+        return compile_parallel(inputs, jobs, opts);
+    }
+    int status = 0;
+    for (const char* input: inputs) {
+        // A lone input compiles to quackmain.c, as it always has
+        std::string outpath = inputs.size() == 1 ? "quackmain.c" : output_path(input);
+        status |= compile_file(input, outpath, opts, std::cout, std::cerr);
+    }
+    return status;
 }
@@ -1,205 +1,337 @@
 #include "ASTNode.h"
+#include "Symbol.h"
+#include "Timing.h"
+#include "Passes.h"
+#include "TypeLattice.h"
+#include "VarEnv.h"
+#include "BuiltinClasses.h"
 #include <string>
 #include <sstream>
 #include <iostream>
 #include <map>
 #include <vector>
 #include <set>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
 
 using namespace std;
 
 class MethodTable {
     public:
-        string methodname;
-        string returntype;
-        vector<string> formalargtypes;
-        map<string, string>* vars;
-        string inheritedfrom;
+        Symbol methodname;
+        Symbol returntype;
+        vector<Symbol> formalargtypes;
+        VarEnv* vars;
+        Symbol inheritedfrom;
 
         MethodTable () {
-            formalargtypes = vector<string>();
-            vars = new map<string, string>();
+            formalargtypes = vector<Symbol>();
+            vars = new_vartable();
         }
 
-        MethodTable(string name) {
+        MethodTable(Symbol name) {
             methodname = name;
-            formalargtypes = vector<string>();
-            vars = new map<string, string>();
+            formalargtypes = vector<Symbol>();
+            vars = new_vartable();
+        }
+
+        // Variable tables belong to the compilation's arena (the builtin
+        // prototype's to an arena of its own), so copies of a MethodTable
+        // may share one and nothing frees it
+        static VarEnv* new_vartable() {
+            return Arena::current()->make<VarEnv>();
         }
 
         void print() {
-            cout << '\t' << "method name: " << methodname << endl;
-            cout << '\t' << "return type: " << returntype << endl;
-            cout << '\t' << "formal arg types: ";
-            for (string formalarg: formalargtypes) {
-                cout << formalarg << ", ";
+            report::out() << '\t' << "method name: " << methodname << endl;
+            report::out() << '\t' << "return type: " << returntype << endl;
+            report::out() << '\t' << "formal arg types: ";
+            for (Symbol formalarg: formalargtypes) {
+                report::out() << formalarg << ", ";
             }
-            cout << endl;
-            cout << "\t" << "variables: " << endl;
-            for(map<string, string>::iterator iter = vars->begin(); iter != vars->end(); ++iter) {
-                cout << "\t\t" << iter->first << ":" << iter->second << endl;
+            report::out() << endl;
+            report::out() << "\t" << "variables: " << endl;
+            for (VarEnv::iterator iter: by_name(*vars)) {
+                report::out() << "\t\t" << iter->first << ":" << iter->second << endl;
             }
-            cout << "\t" << "inheritedfrom: " << inheritedfrom << endl;
-            cout << endl;
+            report::out() << "\t" << "inheritedfrom: " << inheritedfrom << endl;
+            report::out() << endl;
         }
 };
 
 class TypeNode {
     public:
-        string type;
-        string parent;
-        map<string, string> instance_vars;
-        map<string, MethodTable> methods;
+        Symbol type;
+        Symbol parent;
+        map<Symbol, Symbol> instance_vars;
+        map<Symbol, MethodTable> methods;
         MethodTable construct;
-        int resolved;
-        vector<string> methodlist;
+        vector<Symbol> methodlist;
 
         TypeNode() {
-            instance_vars = map<string, string>();
-            methods = map<string, MethodTable>();
+            instance_vars = map<Symbol, Symbol>();
+            methods = map<Symbol, MethodTable>();
             construct = MethodTable();
-            resolved = 0;
-            methodlist = vector<string>();
+            methodlist = vector<Symbol>();
         }
 
-        TypeNode(string name) {
+        TypeNode(Symbol name) {
             type = name;
-            instance_vars = map<string, string>();
-            methods = map<string, MethodTable>();
+            instance_vars = map<Symbol, Symbol>();
+            methods = map<Symbol, MethodTable>();
             construct = MethodTable(name);
             construct.returntype = name;
-            resolved = 0;
-            methodlist = vector<string>();
+            methodlist = vector<Symbol>();
         }
 
         void print() {
-            cout << "Type: " << type << endl;
-            cout << "Parent: " << parent << endl;
-            cout << "Instance vars: " << endl;;
-            for(map<string, string>::iterator iter = instance_vars.begin(); iter != instance_vars.end(); ++iter) {
-                cout << "\t" << iter->first << ":" << iter->second << endl;
-            }
-            cout << "MethodList: ";
-            for (string meth: methodlist) {
-                cout << meth << ", ";
-            }
-            cout << endl;
-            cout << "Methods: " << endl;
-            for(map<string, MethodTable>::iterator iter = methods.begin(); iter != methods.end(); ++iter) {
-                MethodTable method =  iter->second;
-                method.print();
-            }
-            cout << "Constructor: " << endl;
+            report::out() << "Type: " << type << endl;
+            report::out() << "Parent: " << parent << endl;
+            report::out() << "Instance vars: " << endl;;
+            for (map<Symbol, Symbol>::iterator iter: by_name(instance_vars)) {
+                report::out() << "\t" << iter->first << ":" << iter->second << endl;
+            }
+            report::out() << "MethodList: ";
+            for (Symbol meth: methodlist) {
+                report::out() << meth << ", ";
+            }
+            report::out() << endl;
+            report::out() << "Methods: " << endl;
+            for (map<Symbol, MethodTable>::iterator iter: by_name(methods)) {
+                iter->second.print();
+            }
+            report::out() << "Constructor: " << endl;
             construct.print();
         }
 };
 
-class Edge {
+/* A class's methods by vtable slot, which is their order in the
+ * class_X_struct generated for it: its parent's methods first, in their
+ * slots (a method it overrides keeps its slot), then the ones it adds,
+ * by name.  Each slot has the method's signature and, in inheritedfrom,
+ * the class that defines it.
+ */
+class VTable {
     public:
-        vector<string> children;
-        int visited;
+        vector<Symbol> names;                 // By slot
+        vector<const MethodTable*> methods;   // By slot; into the class's TypeNode
+        unordered_map<Symbol, int> slots;
+
+        void add(Symbol name, const MethodTable* method) {
+            slots[name] = (int) names.size();
+            names.push_back(name);
+            methods.push_back(method);
+        }
 
-        Edge() {
-            children = vector<string>();
-            visited = 0;
+        /* The slot of the method named name, or -1 if there is none */
+        int slot(Symbol name) const {
+            unordered_map<Symbol, int>::const_iterator found = slots.find(name);
+            return found == slots.end() ? -1 : found->second;
         }
+};
 
-        void print() {
-            cout << "children: ";
-            for (string child: children) {
-                cout << child << ", ";
-            }
-            cout << endl;
-            cout << "visited: " << visited << endl;
+/* A class's fields by slot, which is their order in the obj_X_struct
+ * generated for it: its parent's first, in their slots, then the ones
+ * its constructor adds, by name.  Field x is this.x in the constructor's
+ * variable table; both names are kept, so checking never builds or
+ * splits one to get the other.
+ */
+class Fields {
+    public:
+        vector<Symbol> names;                 // x, by slot
+        vector<Symbol> keys;                  // this.x, by slot
+        unordered_map<Symbol, int> slots;
+        vector<pair<Symbol, int>> assigned;   // The constructor's this... variables, and the slot of each that is a field, or -1
+
+        void add(Symbol name, Symbol key) {
+            slots[name] = (int) names.size();
+            names.push_back(name);
+            keys.push_back(key);
+        }
+
+        /* The slot of the field named name, or -1 if there is none */
+        int slot(Symbol name) const {
+            unordered_map<Symbol, int>::const_iterator found = slots.find(name);
+            return found == slots.end() ? -1 : found->second;
         }
 };
 
+/* A class as an earlier compilation left it (see quack::ClassCache):
+ * the variable types type checking found, and the code generated for it.
+ */
+class CachedClass {
+    public:
+        map<Symbol, Symbol> instance_vars;
+        map<Symbol, Symbol> constructor_vars;
+        map<Symbol, map<Symbol, Symbol>> method_vars;  // Methods the class defines
+        string code;       // Its C
+        string listing;    // What generating its C printed
+};
+
+/* What one inference of a unit did (see StaticSemantics::typeCheck) */
+class InferEffects {
+    public:
+        int changed = 0;              // A variable's type changed
+        set<Symbol> reads;            // Classes whose instance variables it read
+        long statement_visits = 0;    // Statements it inferred
+        long call_infers = 0;         // Calls
+};
+
 class StaticSemantics {
     public:
-        AST::ASTNode* astroot;
+        AST::ASTNode astroot;
         int found_error;
-        int changed;
-        map<string, TypeNode> hierarchy;
-        map<string, Edge*> edges;
-        vector<string> sortedclasses;
-
-        StaticSemantics(AST::ASTNode* root) { // parameterized constructor
-            astroot = root;
+        map<Symbol, TypeNode> hierarchy;
+        vector<Symbol> sortedclasses;  // Parents before their children
+        TypeLattice lattice;         // The classes by type id, once sorted
+        VarEnv* main_vars = nullptr; // The main program's variables; copied into __pgm__'s instance variables
+        vector<TypeNode*> classes;   // By type id; into hierarchy, whose nodes stay put
+        vector<VTable> vtables;      // By type id, once methods are resolved
+        vector<Fields> fields;       // By type id, once fields are resolved
+
+        // Class cache.  Entries found for this program go in cached
+        // before checking; they are put into the hierarchy (and the
+        // classes become reused) once checking reaches type inference.
+        map<Symbol, CachedClass> cached;
+        set<Symbol> reused;          // Type inference and code generation skip these
+        set<Symbol> noisy;           // Classes whose type inference printed something
+
+        PassManager passes;
+        NodeAnalysis<Symbol> expr_types;   // Types of expressions, as the last inference of their unit found them
+        NodeAnalysis<uint32_t> var_numbers; // Names of Ident and Dot nodes, numbered for initcheck
+        NodeAnalysis<Symbol> dot_names;     // Dot nodes: the variable each names, this.x
+        NodeAnalysis<pair<int, int>> field_slots;  // Dot nodes: type id and slot of the field, once inferred
+
+        // What checking and code generation did, for --time-report
+        Timings* timings = nullptr;  // If set, each pass of checkAST is timed into it
+        bool listing = false;        // Print the class hierarchy when checking stops
+        int threads = 1;             // Type check on this many threads (see typeCheck)
+        long unit_runs = 0;          // Constructors, methods and main programs inferred
+        long waves = 0;              // Waves of the worklist they were inferred in
+        InferEffects inferred;       // Statements and calls all type inference took up
+        long registers = 0;          // Registers and branch labels code generation allocated
+        long labels = 0;
+        long codegen_infers = 0;     // Expressions code generation had no recorded type for
+
+        StaticSemantics(AST::ASTNode root) : astroot{root}, expr_types{passes.analysis<Symbol>()},
+                                            var_numbers{passes.analysis<uint32_t>()}, dot_names{passes.analysis<Symbol>()},
+                                            field_slots{passes.analysis<pair<int, int>>()} { // parameterized constructor
+            expr_types.reserve(root.tree()->nodes());   // Set from several threads (see typeCheck)
+            field_slots.reserve(root.tree()->nodes());
             found_error = 0;
-            changed = 1;
-            hierarchy = map<string, TypeNode>();
-            edges = map<string, Edge*>();
-            sortedclasses = vector<string>();
+            hierarchy = map<Symbol, TypeNode>();
+            sortedclasses = vector<Symbol>();
 
         }
-        // TODO: create destructor?
+        // No destructor needed: the variable tables are in the arena
+        StaticSemantics(const StaticSemantics&) = delete;  // The passes and analyses refer to it
+
+        /* Check that the classes form a tree under Obj, and list them in
+         * sortedclasses parents first.  This is Kahn's topological sort:
+         * a class is listed once its parent is.  Since each class has one
+         * parent, that is a breadth-first walk down from Obj, in time and
+         * space linear in the number of classes.  Reports a superclass that
+         * isn't defined, or a cycle of classes (which the walk never
+         * reaches, since no class in it descends from Obj).  False if
+         * there was either.
+         */
+        bool toposort() {
+            size_t n = hierarchy.size();
+            vector<TypeNode*> nodes;
+            unordered_map<Symbol, int> index;
+            nodes.reserve(n);
+            index.reserve(n);
+            // The program's classes in program order, not symbol id order,
+            // which depends on what was interned before (by earlier requests
+            // to a server): the same program gets the same errors.  The rest
+            // (builtins, __pgm__) have fixed symbols.
+            for (AST::ASTNode cls: astroot[0]) {
+                map<Symbol, TypeNode>::iterator found = hierarchy.find(cls[0].get_var());
+                if (found != hierarchy.end() && index.emplace(found->first, (int) nodes.size()).second) {
+                    nodes.push_back(&found->second);
+                }
+            }
+            for (map<Symbol, TypeNode>::iterator iter = hierarchy.begin(); iter != hierarchy.end(); ++iter) {
+                if (index.emplace(iter->first, (int) nodes.size()).second) {
+                    nodes.push_back(&iter->second);
+                }
+            }
 
-        void toposort() {
-            sortedclasses.push_back("Obj");
-            for(map<string,TypeNode>::iterator iter = hierarchy.begin(); iter != hierarchy.end(); ++iter) {
-                TypeNode *node = &hierarchy[iter->first]; // get node directly from map
-                toposort_aux(node);
+            // Children of i are children[first[i]] .. children[first[i + 1] - 1]
+            vector<int> parent(n, -1);
+            vector<int> first(n + 1, 0);
+            for (size_t i = 0; i < n; ++i) {
+                if (nodes[i]->type == sym::Obj) { continue; }
+                unordered_map<Symbol, int>::iterator found = index.find(nodes[i]->parent);
+                if (found == index.end()) {
+                    report::semantic_error() << "Error: class " << nodes[i]->parent << " undefined, but is superclass of " << nodes[i]->type << endl;
+                    return false;
+                }
+                parent[i] = found->second;
+                ++first[parent[i] + 1];
             }
-        }
-        void toposort_aux(TypeNode* node) {
-            if (!node->resolved) {
-                string parent = node->parent;
-                TypeNode* pp = &hierarchy[parent];
-                toposort_aux(pp);
-                sortedclasses.push_back(node->type);
-                node->resolved = 1;
+            for (size_t i = 0; i < n; ++i) { first[i + 1] += first[i]; }
+            vector<int> children(first[n]);
+            vector<int> next(first.begin(), first.end() - 1);
+            for (size_t i = 0; i < n; ++i) {
+                if (parent[i] >= 0) { children[next[parent[i]]++] = (int) i; }
             }
-        }
 
-        int populateEdges() {
-            for(map<string,TypeNode>::iterator iter = hierarchy.begin(); iter != hierarchy.end(); ++iter) {
-                TypeNode node = iter->second;
-                edges[node.type] = new Edge();
+            vector<int> order;
+            order.reserve(n);
+            order.push_back(index.at(sym::Obj));
+            for (size_t head = 0; head < order.size(); ++head) {
+                int id = order[head];
+                order.insert(order.end(), children.begin() + first[id], children.begin() + first[id + 1]);
             }
-            for(map<string,TypeNode>::iterator iter = hierarchy.begin(); iter != hierarchy.end(); ++iter) {
-                TypeNode node = iter->second;
-                string parent = node.parent;
-                if (iter->first == "Obj") {
-                    continue;
-                }
-                if (!edges.count(node.parent)) {
-                    cout << "Error: class " << node.parent << " undefined, but is superclass of " << iter->first << endl;
-                    return 0;
+
+            if (order.size() < n) {
+                // Each class left extends another one left, so following
+                // superclasses from any of them goes round a cycle
+                vector<int> seen(n, 0);
+                for (int id: order) { seen[id] = 1; }
+                int start = 0;
+                while (seen[start]) { ++start; }
+                while (seen[start] != 2) {
+                    seen[start] = 2;
+                    start = parent[start];
                 }
-                edges[node.parent]->children.push_back(node.type);
+                report::semantic_error() << "Error: class " << nodes[start]->type << " extends itself:";
+                int id = start;
+                do {
+                    report::out() << " " << nodes[id]->type << " extends";
+                    id = parent[id];
+                } while (id != start);
+                report::out() << " " << nodes[start]->type << endl;
+                report::out() << "GRAPH CYCLE DETECTED" << endl;
+                return false;
             }
-            return 1;
-        }
+            if (listing) { report::out() << "GRAPH ACYCLIC" << endl; }
 
-        int isCyclic(string root) {
-            Edge* rootedge = edges[root];
-            for (string child: rootedge->children) {
-                Edge* childedge = edges[child];
-                if (childedge->visited) { return 1;} // cycle!!
-                childedge->visited = 1;
-                if (isCyclic(child)) { return 1;}
-            }
-            return 0;
+            sortedclasses.clear();
+            sortedclasses.reserve(n);
+            for (int id: order) { sortedclasses.push_back(nodes[id]->type); }
+            return true;
         }
 
         void printClassHierarchy() {
-            cout << "=========CLASS HIERARCHY============" << endl;
-            for(map<string,TypeNode>::iterator iter = hierarchy.begin(); iter != hierarchy.end(); ++iter) {
-                TypeNode node = iter->second;
-                node.print();
-                cout << "===================================" << endl;
+            report::out() << "=========CLASS HIERARCHY============" << endl;
+            for (map<Symbol,TypeNode>::iterator iter: by_name(hierarchy)) {
+                iter->second.print();
+                report::out() << "===================================" << endl;
             }
         }
 
         void populateClassHierarchy() { // create class hierarchy
             populateBuiltins();
 
-            // Traverse the classes
-            AST::Program *root = (AST::Program*) astroot;
-            AST::Classes classesnode = root->classes_;
-            vector<AST::Class *> classes = classesnode.elements_;
-            for (AST::Class *el: classes) {
-                string classname = el->name_.text_;
+            // Traverse the classes (see ASTNode.h for the children of each kind of node)
+            AST::ASTNode classesnode = astroot[0];
+            for (AST::ASTNode el: classesnode) {
+                Symbol classname = el[0].text();
                 TypeNode node;
                 if (hierarchy.count(classname)) { // if already in table
                     node = hierarchy[classname]; // just fetch that node
@@ -207,40 +339,26 @@ class StaticSemantics {
                 else {
                     node = TypeNode(classname); // otherwise create new node
                 }
-                node.parent = el->super_.text_; // update superclass
+                node.parent = el[1].text(); // update superclass
 
                 // constructor (node.construct already exists and is a Method object with name initialized)
-                AST::Method *constructor = (AST::Method *) &(el->constructor_);
-                AST::Ident *returnt = (AST::Ident*) &(constructor->returns_);
-                node.construct.returntype = returnt->text_; // fill out returntype
-                AST::Formals* formalsnode = (AST::Formals*) &(constructor->formals_);
-                vector<AST::Formal *> formals = formalsnode->elements_;
-                for (AST::Formal *formal: formals) {
-                        AST::Ident *type = (AST::Ident *) &(formal->type_);
-                        node.construct.formalargtypes.push_back(type->text_); // populate formal arg types
+                AST::ASTNode constructor = el[2];
+                node.construct.returntype = constructor[2].text(); // fill out returntype
+                for (AST::ASTNode formal: constructor[1]) {
+                        node.construct.formalargtypes.push_back(formal[1].text()); // populate formal arg types
                     }
 
-                // instancevars (can be found in the statements_ attribute (AST::Block node) of the constructor AST::Method node)
-                AST::Block* blocknode = (AST::Block*) &(constructor->statements_);
-                vector<AST::Statement *> *statements = (vector<AST::Statement *> *) &blocknode->elements_;
-                vector<AST::Statement *> stmts = *statements;
-
-                for (AST::Statement *stmt: stmts) {
-                    stmt->collect_vars(&node.instance_vars);
+                // instancevars (can be found in the statements (Block node) of the constructor Method node)
+                for (AST::ASTNode stmt: constructor[3]) {
+                    stmt.collect_vars(&node.instance_vars);
                 } 
 
                 // methods 
-                vector<AST::Method *> methods = (el->methods_).elements_;
-                for (AST::Method *meth: methods) {
-                    AST::Ident* methodname = (AST::Ident*) &(meth->name_);
-                    AST::Ident* returntype = (AST::Ident*) &(meth->returns_);
-                    MethodTable newmethod(methodname->text_);
-                    newmethod.returntype = returntype->text_;
-                    AST::Formals* formalsnode = (AST::Formals*) &(meth->formals_);
-                    vector<AST::Formal *> formals = formalsnode->elements_;
-                    for (AST::Formal *formal: formals) {
-                        AST::Ident *type = (AST::Ident *) &(formal->type_);
-                        newmethod.formalargtypes.push_back(type->text_);
+                for (AST::ASTNode meth: el[3]) {
+                    MethodTable newmethod(meth[0].text());
+                    newmethod.returntype = meth[2].text();
+                    for (AST::ASTNode formal: meth[1]) {
+                        newmethod.formalargtypes.push_back(formal[1].text());
                     }
                     newmethod.inheritedfrom = classname;
                     node.methods[newmethod.methodname] = newmethod;
@@ -250,90 +368,204 @@ class StaticSemantics {
             } // end for class in classes
         } // end populateClassHierarchy
 
-        int search_vector(vector<string>* vec, string target) {
-            for (string s: *vec) {
-                if (s == target) { return 1; }
-            }
-            return 0;
-        }
-        void inherit_methods() {
-            for (string classname: sortedclasses) {
-                if (classname == "Obj") {continue;}
-                if (classname == "__pgm__") {continue;}
-                TypeNode *classnode = &hierarchy[classname];
-                map<string, MethodTable> *classmethods = &classnode->methods;
-                string parent = classnode->parent;
-                TypeNode *parentnode = &hierarchy[parent];
-                for (string meth: parentnode->methodlist) {
-                    classnode->methodlist.push_back(meth);
+        /* Give each class, parents first, the methods it inherits, and
+         * lay out its vtable (see VTable)
+         */
+        void resolve_methods() {
+            vtables.assign(classes.size(), VTable());
+            for (size_t id = 0; id < classes.size(); ++id) {
+                TypeNode *classnode = classes[id];
+                map<Symbol, MethodTable> *classmethods = &classnode->methods;
+                // The builtins come laid out as the runtime has them (see BuiltinClasses.h)
+                if (classnode->methodlist.empty() && classnode->type != sym::pgm) {
+                    TypeNode *parentnode = classes[lattice.parent(id)];
+                    for (Symbol meth: parentnode->methodlist) {
+                        classnode->methodlist.push_back(meth);
+                    }
+                    set<Symbol> listed(classnode->methodlist.begin(), classnode->methodlist.end());
+                    for (map<Symbol, MethodTable>::iterator iter: by_name(*classmethods)) { // methodlist order is struct layout
+                        if (listed.insert(iter->first).second) {
+                            classnode->methodlist.push_back(iter->first);
+                        }
+                    }
+                    for (Symbol s: classnode->methodlist) {
+                        if (!classmethods->count(s)) {
+                            (*classmethods)[s] = parentnode->methods[s];
+                        }
+                    }
                 }
-                for (map<string, MethodTable>::iterator iter = classmethods->begin(); iter != classmethods->end(); ++iter) {
-                    if (!search_vector(&classnode->methodlist, iter->first)) {
-                        classnode->methodlist.push_back(iter->first);
+                VTable& vtable = vtables[id];
+                for (Symbol meth: classnode->methodlist) {
+                    vtable.add(meth, &classmethods->at(meth));
+                }
+            }
+        }
+
+        /* Lay out each class's fields, parents first (see Fields), and
+         * name each Dot once, for the passes after
+         */
+        void resolve_fields() {
+            fields.assign(classes.size(), Fields());
+            for (size_t id = 0; id < classes.size(); ++id) {
+                Fields& layout = fields[id];
+                int parent = lattice.parent(id);
+                if (parent >= 0) {
+                    const Fields& inherited = fields[parent];
+                    for (size_t slot = 0; slot < inherited.names.size(); ++slot) {
+                        layout.add(inherited.names[slot], inherited.keys[slot]);
                     }
                 }
-                for (string s: classnode->methodlist) {
-                    if (!classmethods->count(s)) {
-                        MethodTable parentmethod = parentnode->methods[s];
-                        MethodTable mt = MethodTable(parentmethod);
-                        (*classmethods)[s] = mt;
+                for (map<Symbol, Symbol>::iterator iter: by_name(classes[id]->instance_vars)) {
+                    const string& key = iter->first.str();
+                    if (key.rfind("this", 0) != 0) { continue; }
+                    int slot = -1;
+                    if (key.size() > 5 && key[4] == '.' && key.find('.', 5) == string::npos) {
+                        Symbol name(key.substr(5));
+                        slot = layout.slot(name);
+                        if (slot < 0) {
+                            slot = (int) layout.names.size();
+                            layout.add(name, iter->first);
+                        }
                     }
+                    layout.assigned.push_back(make_pair(iter->first, slot));
                 }
             }
-        }
 
-        int is_subtype(string sub, string super) {
-            // return 1 if sub is substype of super, 0 otherwise
-            set<string> sub_path_to_root = set<string>();
-            string type = sub;
-            if (!hierarchy.count(type)) { // subtype not in class hierarchy
-                cout << "ERROR: type " << type << " not in class hierarchy" << endl;
-                return 0;
+            AST::Tree* tree = astroot.tree();
+            dot_names.reserve(tree->nodes());
+            for (AST::Node n = 0; n < tree->nodes(); ++n) {
+                if (tree->kind(n) == AST::Kind::Dot) {
+                    dot_names.set(n, AST::ASTNode(tree, n).get_var());
+                }
             }
-            while (1) {
-                sub_path_to_root.insert(type);
-                if (type == "Obj") { break; }
-                type = hierarchy[type].parent;
+        }
+
+        /* Number the classes (see TypeLattice.h), once the hierarchy is a tree */
+        void number_types() {
+            vector<pair<Symbol, Symbol>> classes;
+            classes.reserve(sortedclasses.size());
+            for (Symbol classname: sortedclasses) {
+                classes.push_back(make_pair(classname, hierarchy[classname].parent));
             }
-            if (sub_path_to_root.count(super)) {
-                return 1;
+            lattice.build(classes);
+            this->classes.clear();
+            this->classes.reserve(sortedclasses.size());
+            for (Symbol classname: sortedclasses) {
+                this->classes.push_back(&hierarchy[classname]);
             }
-            return 0;
         }
 
-        string get_LCA(string type1, string type2) {
-            // TODO: this section is garbage and shouldn't be necessary when rest is working
-            if (type1 == "Bottom") { return type2;}
-            if (type2 == "Bottom") { return type1;}
-            if (type1 == "TypeError") { return type2;}
-            if (type2 == "TypeError") { return type1;}
-            if (!hierarchy.count(type1)) { // if we have a type that is NOT in the table...
-                return type1; // for now we're just going to call it that type
+        /* Queries about classes look them up by type id, rather than copying
+         * the class (or the whole hierarchy) for each expression.
+         */
+
+        /* The class named classname, or nullptr if there is none */
+        const TypeNode* find_class(Symbol classname) const {
+            int id = lattice.id(classname);
+            return id >= 0 ? classes[id] : nullptr;
+        }
+
+        /* The vtable of a class (which must exist) */
+        const VTable& vtable_of(Symbol classname) const {
+            return vtables[lattice.id(classname)];
+        }
+
+        /* The fields of a class (which must exist) */
+        const Fields& fields_of(Symbol classname) const {
+            return fields[lattice.id(classname)];
+        }
+
+        /* The variable node names: x for an Ident, this.x for a Dot (named
+         * once, by resolve_fields)
+         */
+        Symbol var_name(AST::ASTNode node) const {
+            if (node.kind() == AST::Kind::Dot && dot_names.has(node.id())) { return dot_names.get(node.id()); }
+            return node.get_var();
+        }
+
+        /* The type of field of classname, or the empty symbol if it has
+         * none.  A Dot that names a field of its class is resolved to its
+         * slot, for code generation (see field_of).
+         */
+        Symbol resolve_field(AST::ASTNode dot, Symbol classname, Symbol field) {
+            int id = lattice.id(classname);
+            if (id < 0) { return Symbol(); }
+            const map<Symbol, Symbol>& instancevars = classes[id]->instance_vars;
+            map<Symbol, Symbol>::const_iterator found = instancevars.find(field);
+            if (found == instancevars.end()) { return Symbol(); }
+            int slot = (size_t) id < fields.size() ? fields[id].slot(field) : -1;
+            if (slot >= 0) { field_slots.set(dot.id(), make_pair(id, slot)); }
+            return found->second;
+        }
+
+        /* The field a Dot was resolved to, or the empty symbol */
+        Symbol field_of(AST::ASTNode dot) const {
+            if (!field_slots.has(dot.id())) { return Symbol(); }
+            pair<int, int> field = field_slots.get(dot.id());
+            return fields[field.first].names[field.second];
+        }
+
+        /* The method a class defines or inherits, or nullptr if it has none */
+        const MethodTable* find_method(Symbol classname, Symbol methodname) const {
+            int id = lattice.id(classname);
+            if (id < 0) { return nullptr; }
+            int slot = vtables[id].slot(methodname);
+            return slot >= 0 ? vtables[id].methods[slot] : nullptr;
+        }
+
+        /* The variables of a method of classname, or of its constructor,
+         * or (classname __pgm__) of the main program.  Neither the class nor
+         * the method is added if it doesn't exist: there are no variables,
+         * and the table returned is one shared empty one.
+         */
+        VarEnv* vars_of(Symbol classname, Symbol methodname) {
+            static VarEnv none;
+            if (methodname == sym::pgm) {
+                return main_vars;
             }
-            if (!hierarchy.count(type2)) { // if we have a type that is NOT in the table...
-                return type2; // for now we're just going to call it that type
+            int id = lattice.id(classname);
+            TypeNode* classnode = id >= 0 ? classes[id] : nullptr;
+            if (classnode == nullptr) {
+                map<Symbol, TypeNode>::iterator found = hierarchy.find(classname);
+                if (found == hierarchy.end()) { return &none; }
+                classnode = &found->second;
             }
-            set<string> type1_path = set<string>();
-            string type = type1;
-            while (1) {
-                type1_path.insert(type);
-                if (type == "Obj") { break; }
-                type = hierarchy[type].parent;
+            if (methodname == sym::constructor || methodname == classname) {
+                return classnode->construct.vars;
             }
-            type = type2;
-            while (1) {
-                if (type1_path.count(type)) {
-                    return type;
-                }
-                type = hierarchy[type].parent;
+            map<Symbol, MethodTable>::iterator method = classnode->methods.find(methodname);
+            return method != classnode->methods.end() ? method->second.vars : &none;
+        }
+
+        int is_subtype(Symbol sub, Symbol super) {
+            // return 1 if sub is substype of super, 0 otherwise
+            int sub_id = lattice.id(sub);
+            if (sub_id < 0) { // subtype not in class hierarchy
+                report::semantic_error() << "ERROR: type " << sub << " not in class hierarchy" << endl;
+                return 0;
             }
+            int super_id = lattice.id(super);
+            return super_id >= 0 && lattice.is_subtype(sub_id, super_id);
         }
 
-        int compare_maps(map<string, string> map1, map<string, string>map2) {
+        Symbol get_LCA(Symbol type1, Symbol type2) {
+            int id1 = lattice.id(type1), id2 = lattice.id(type2);
+            if (id1 == TypeLattice::BOTTOM) { return type2; }
+            if (id2 == TypeLattice::BOTTOM) { return type1; }
+            if (id1 == TypeLattice::NONE) { // if we have a type that is NOT in the table...
+                return type1; // for now we're just going to call it that type
+            }
+            if (id2 == TypeLattice::NONE) {
+                return type2;
+            }
+            return lattice.type(lattice.join(id1, id2));
+        }
+
+        int compare_maps(map<Symbol, Symbol> map1, map<Symbol, Symbol>map2) {
             // same types, proceed to compare maps here
             if(map1.size() != map2.size())
                 return 0;  // differing sizes, they are not the same
-            typename map<string,string>::const_iterator i, j;
+            typename map<Symbol,Symbol>::const_iterator i, j;
             for(i = map1.begin(), j = map2.begin(); i != map1.end(); ++i, ++j)
             {
                 if(*i != *j)
@@ -342,107 +574,349 @@ class StaticSemantics {
             return 1;
         }
 
-        vector<string> split(string strToSplit, char delimeter)
-        {
-            stringstream ss(strToSplit);
-            string item;
-            vector<string> splittedStrings;
-            while (getline(ss, item, delimeter))
-            {
-            splittedStrings.push_back(item);
-            }
-            return splittedStrings;
+        /* Type inference works on units: the constructor of a class, one
+         * of its methods, or the main program.  A unit writes only its own
+         * variable table, and a constructor the instance variables of its
+         * class, so a unit need only be inferred again when its own table
+         * changed or when the instance variables of a class it read did.
+         * typeCheck keeps a worklist of those rather than inferring the
+         * whole program again whenever anything changes.
+         *
+         * The worklist is taken in waves.  Every unit in a wave sees the
+         * instance variables as the wave began: a constructor's changes
+         * to its class's are made once the wave is over, in program order.
+         * So the units of a wave don't depend on one another, and with
+         * threads > 1 they are inferred side by side, with the same result.
+         */
+        struct InferUnit {
+            enum Kind { CONSTRUCTOR, METHOD, MAIN };
+            Kind kind;
+            AST::ASTNode node;      // The Class, the Method, or the main program's Block
+            Symbol classname;       // __pgm__ for the main program
+            Symbol methodname;
+            InferEffects effects;   // What its last inference did
+            string messages;        // and printed
+            string diagnostics;
+            int errors = 0;         // and the errors it counted
+            bool queued = false;
+            InferUnit(Kind kind, AST::ASTNode node, Symbol classname, Symbol methodname)
+                : kind{kind}, node{node}, classname{classname}, methodname{methodname} {}
+        };
+        vector<InferUnit> units;               // In program order
+        map<Symbol, set<size_t>> readers;      // Units that read each class's instance variables
+
+        /* The unit being inferred on the calling thread, if any */
+        static InferUnit*& running() {
+            static thread_local InferUnit* unit = nullptr;
+            return unit;
+        }
+
+        /* Where type inference on the calling thread records what it did:
+         * the unit it is inferring, or else (code generation asks for
+         * types, too) the checker's totals
+         */
+        InferEffects& effects() {
+            InferUnit* unit = running();
+            return unit ? unit->effects : inferred;
         }
 
-        map<string, TypeNode>* typeCheck() {
-            AST::Program *root = (AST::Program*) astroot;
-            while (changed) {
-                changed = 0;
-                root->type_infer(this, nullptr, nullptr); 
+        /* The inference in progress depends on classname's instance variables */
+        void reads_instance_vars(Symbol classname) {
+            effects().reads.insert(classname);
+        }
+
+        map<Symbol, TypeNode>* typeCheck() {
+            for (AST::ASTNode cls: astroot[0]) {
+                Symbol classname = cls[0].get_var();
+                if (reused.count(classname)) { continue; }  // checked by an earlier compilation
+                units.push_back(InferUnit(InferUnit::CONSTRUCTOR, cls, classname, sym::empty));
+                for (AST::ASTNode meth: cls[3]) {
+                    units.push_back(InferUnit(InferUnit::METHOD, meth, classname, meth[0].get_var()));
+                }
+            }
+            units.push_back(InferUnit(InferUnit::MAIN, astroot[1], sym::pgm, sym::empty));
+
+            for (InferUnit& unit: units) { unit.queued = true; }
+            vector<size_t> wave;
+            while (true) {
+                wave.clear();
+                for (size_t u = 0; u < units.size(); ++u) {
+                    if (units[u].queued) {
+                        wave.push_back(u);
+                        units[u].queued = false;
+                    }
+                }
+                if (wave.empty()) { break; }
+                infer_wave(wave);
+                ++waves;
+                // Every unit of the wave is a reader before any constructor's
+                // instance variables change, so those later in the wave are
+                // inferred again too
+                for (size_t u: wave) {
+                    InferUnit& unit = units[u];
+                    inferred.statement_visits += unit.effects.statement_visits;
+                    inferred.call_infers += unit.effects.call_infers;
+                    for (Symbol classname: unit.effects.reads) {
+                        readers[classname].insert(u);
+                    }
+                    if (unit.effects.changed) { unit.queued = true; }
+                }
+                for (size_t u: wave) {
+                    InferUnit& unit = units[u];
+                    if (unit.kind == InferUnit::CONSTRUCTOR && update_instance_vars(unit.classname)) {
+                        for (size_t reader: readers[unit.classname]) {
+                            units[reader].queued = true;
+                        }
+                    }
+                }
+            }
+
+            // What each unit found the last time, once types had settled,
+            // in program order; the classes' instance variables are
+            // checked against their parents' before the main program
+            int errors = 0;
+            for (InferUnit& unit: units) {
+                if (unit.kind == InferUnit::MAIN) {
+                    check_inherited_instance_vars();
+                }
+                report::out() << unit.messages;
+                report::err() << unit.diagnostics;
+                errors += unit.errors;
+                if (!unit.messages.empty()) { noisy.insert(unit.classname); }
             }
+            report::count(errors);
             return &this->hierarchy;
         } // end typeCheck
 
-        void populateBuiltins() {
-            // pseudo-class for program: __pgm__
-            TypeNode program("__pgm__");
-            program.parent = "Obj";
-            hierarchy["__pgm__"] = program;
-
-            TypeNode obj("Obj");
-            obj.parent = "TYPE_ERROR";
-            MethodTable objprint("PRINT");
-            objprint.returntype = "Obj";
-            objprint.formalargtypes.push_back("Obj");
-            objprint.inheritedfrom = "Obj";
-            obj.methods["PRINT"] = objprint;
-            MethodTable objstring("STRING");
-            objstring.returntype = "String";
-            objstring.formalargtypes.push_back("Obj");
-            objstring.inheritedfrom = "Obj";
-            obj.methods["STRING"] = objstring;
-            MethodTable objequals("EQUALS");
-            objequals.returntype = "Boolean";
-            objequals.formalargtypes.push_back("Obj");
-            objequals.formalargtypes.push_back("Obj");
-            objequals.inheritedfrom = "Obj";
-            obj.methods["EQUALS"] = objequals;
-            obj.resolved = 1;
-            obj.methodlist.push_back("STRING");
-            obj.methodlist.push_back("PRINT");
-            obj.methodlist.push_back("EQUALS");
-            hierarchy["Obj"] = obj;
-
-            TypeNode integer("Int");
-            integer.parent = "Obj";
-            hierarchy["Int"] = integer;
-            MethodTable intplus("PLUS");
-            intplus.returntype = "Int";
-            intplus.inheritedfrom = "Int";
-            intplus.formalargtypes.push_back("Int");
-            hierarchy["Int"].methods["PLUS"] = intplus;
-            MethodTable intgreater(">");
-            intgreater.returntype = "Boolean";
-            intgreater.inheritedfrom = "Int";
-            intgreater.formalargtypes.push_back("Int");
-            hierarchy["Int"].methods[">"] = intgreater;
-
-            TypeNode str("String");
-            str.parent = "Obj";
-            hierarchy["String"] = str;
-
-            TypeNode boolean("Boolean");
-            boolean.parent = "Obj";
-            hierarchy["Boolean"] = boolean;
-
-            TypeNode nothing("Nothing");
-            nothing.parent = "Obj";
+        /* Infer the units of a wave, on up to threads threads */
+        void infer_wave(const vector<size_t>& wave) {
+            unit_runs += wave.size();
+            size_t workers = min(wave.size(), (size_t) max(threads, 1));
+            if (workers <= 1) {
+                for (size_t u: wave) { infer_unit(units[u]); }
+                return;
+            }
+            atomic<size_t> next(0);
+            vector<thread> pool;
+            for (size_t i = 0; i < workers; ++i) {
+                pool.emplace_back([&]() {
+                    size_t job;
+                    while ((job = next++) < wave.size()) {
+                        infer_unit(units[wave[job]]);
+                    }
+                });
+            }
+            for (thread& worker: pool) {
+                worker.join();
+            }
         }
 
-        void* checkAST() { // top-level
-            populateClassHierarchy();
-            if (!populateEdges()) {
-                return nullptr;
+        /* Infer one unit, which may be on a thread of its own: it writes
+         * only its own variable table and its InferUnit
+         */
+        void infer_unit(InferUnit& unit) {
+            running() = &unit;
+            unit.effects = InferEffects();
+            unit.effects.reads.insert(unit.classname);
+            ostringstream messages, diagnostics;
+            report::Scope scope(messages, diagnostics);
+            class_and_method info(unit.classname, unit.methodname);
+            TypeNode* classnode = classes[lattice.id(unit.classname)];
+            if (unit.kind == InferUnit::CONSTRUCTOR) {
+                unit.node[2].type_infer(this, classnode->construct.vars, &info, &expr_types);
             }
-            
-            if (isCyclic("Obj")) {
-                cout << "GRAPH CYCLE DETECTED" << endl;
-                return nullptr;
+            else if (unit.kind == InferUnit::METHOD) {
+                VarEnv* vars = classnode->methods.at(unit.methodname).vars;
+                unit.node.type_infer(this, vars, &info, &expr_types);
+                check_method_instance_vars(unit.classname, unit.methodname, vars);
             }
             else {
-                cout << "GRAPH ACYCLIC" << endl;
-            }
-            toposort();
-            inherit_methods();
-            printClassHierarchy();
-            AST::Program *root = (AST::Program*) astroot;
-            set<string> *vars = new set<string>;
-            if (root->initcheck(vars, this)) { 
-                cout << "INITIALIZATION ERRORS" << endl;
+                // Only the main program reads __pgm__'s instance variables
+                unit.node.type_infer(this, main_vars, &info, &expr_types);
+                for (VarEnv::iterator var = main_vars->begin(); var != main_vars->end(); ++var) {
+                    classnode->instance_vars[var->first] = var->second;
+                }
+            }
+            unit.messages = messages.str();
+            unit.diagnostics = diagnostics.str();
+            unit.errors = scope.error_count;
+            running() = nullptr;
+        }
+
+        /* The constructor of classname has been inferred: its class's
+         * instance variables take the types of the constructor's this.x.
+         * True if that changed them.
+         */
+        bool update_instance_vars(Symbol classname) {
+            int id = lattice.id(classname);
+            map<Symbol, Symbol>* classinstancevars = &classes[id]->instance_vars;
+            map<Symbol, Symbol> before = *classinstancevars;
+            VarEnv* construct_instvars = classes[id]->construct.vars;
+            const Fields& layout = fields[id];
+            for (const pair<Symbol, int>& var: layout.assigned) {
+                Symbol type = construct_instvars->get(var.first);
+                (*classinstancevars)[var.first] = type;
+                if (var.second >= 0) { (*classinstancevars)[layout.names[var.second]] = type; } // and field x
+            }
+            (*classinstancevars)[sym::this_] = classname; // put a this in there!
+            construct_instvars->set(sym::this_, classname);
+            return *classinstancevars != before;
+        }
+
+        /* Are the class instance vars a method assigns given conformant types? */
+        void check_method_instance_vars(Symbol classname, Symbol methodname, VarEnv* methodvars) {
+            const map<Symbol, Symbol>& classinstance = find_class(classname)->instance_vars;
+            for (VarEnv::iterator iter: by_name(*methodvars)) {
+                if (classinstance.count(iter->first)) { // if this var is in the class instance table
+                    Symbol methodtype = iter->second;
+                    Symbol classtype = classinstance.at(iter->first);
+                    if (!is_subtype(methodtype, classtype)) {
+                        report::semantic_error() << "Error (Methods): instance variable " << iter->first << " assigned non-conformant"
+                                        << " type in method " << methodname << ". Instance type: " << classtype
+                                        << ", Method assigned type: " << methodtype << endl;
+                    }
+                }
+            }
+        }
+
+        /* Do subclasses have all their superclass's instance variables? */
+        void check_inherited_instance_vars() {
+            for (AST::ASTNode cls: astroot[0]) {
+                Symbol classname  = cls.child(0).get_var();
+                const TypeNode* classnode = find_class(classname);
+                const map<Symbol, Symbol>& class_iv = classnode->instance_vars;
+                const map<Symbol, Symbol>& parent_iv = find_class(classnode->parent)->instance_vars;
+                for (map<Symbol, Symbol>::const_iterator iter: by_name(parent_iv)) {
+                    Symbol var_name = iter->first;
+                    if (!class_iv.count(var_name)) {
+                        report::semantic_error() << "Error: class " << classname << " missing parent instance var " << var_name << endl;
+                    }
+                }
+            }
+        }
+
+        /* Put the variable types of the cached classes into the hierarchy */
+        void restore_cached() {
+            for (map<Symbol, CachedClass>::iterator iter = cached.begin(); iter != cached.end(); ++iter) {
+                TypeNode* node = &hierarchy[iter->first];
+                CachedClass* entry = &iter->second;
+                node->instance_vars = entry->instance_vars;
+                node->construct.vars->assign(entry->constructor_vars);
+                for (map<Symbol, map<Symbol, Symbol>>::iterator meth = entry->method_vars.begin(); meth != entry->method_vars.end(); ++meth) {
+                    node->methods[meth->first].vars->assign(meth->second);
+                }
+                reused.insert(iter->first);
+            }
+        }
+
+        /* What type inference found for a class, to be cached */
+        CachedClass save_class(Symbol classname) {
+            TypeNode* node = &hierarchy[classname];
+            CachedClass entry;
+            entry.instance_vars = node->instance_vars;
+            entry.constructor_vars = node->construct.vars->to_map();
+            for (map<Symbol, MethodTable>::iterator meth = node->methods.begin(); meth != node->methods.end(); ++meth) {
+                if (meth->second.inheritedfrom == classname) {
+                    entry.method_vars[meth->first] = meth->second.vars->to_map();
+                }
+            }
+            return entry;
+        }
+
+        /* The builtin classes are the same in every program (see
+         * BuiltinClasses.h), so they are built once per process and
+         * copied into each new hierarchy.
+         */
+        static const map<Symbol, TypeNode>& builtins() {
+            static const map<Symbol, TypeNode> prototype = build_builtins();
+            return prototype;
+        }
+
+        void populateBuiltins() {
+            hierarchy = builtins();
+            main_vars = MethodTable::new_vartable();
+            // Variable tables are filled in by type checking, so each compilation gets its own
+            for (map<Symbol, TypeNode>::iterator iter = hierarchy.begin(); iter != hierarchy.end(); ++iter) {
+                TypeNode& node = iter->second;
+                node.construct.vars = MethodTable::new_vartable();
+                for (map<Symbol, MethodTable>::iterator meth = node.methods.begin(); meth != node.methods.end(); ++meth) {
+                    meth->second.vars = MethodTable::new_vartable();
+                }
+            }
+        }
+
+        static map<Symbol, TypeNode> build_builtins() {
+            static Arena arena;  // Holds the prototype's tables; outlives every compilation
+            Arena* saved = Arena::current();
+            Arena::current() = &arena;
+            map<Symbol, TypeNode> hierarchy;
+            // pseudo-class for program: __pgm__
+            TypeNode program(sym::pgm);
+            program.parent = sym::Obj;
+            hierarchy[sym::pgm] = program;
+
+            for (const builtin::Class& cls: builtin::classes) {
+                TypeNode node(cls.name);
+                node.parent = cls.parent ? Symbol(cls.parent) : Symbol("TYPE_ERROR");
+                for (size_t slot = 0; slot < cls.count; ++slot) {
+                    const builtin::Method& entry = cls.methods[slot];
+                    MethodTable method(entry.name);
+                    method.returntype = entry.returns;
+                    if (entry.formal) { method.formalargtypes.push_back(entry.formal); }
+                    method.inheritedfrom = entry.from;
+                    node.methods[method.methodname] = method;
+                    node.methodlist.push_back(method.methodname);
+                }
+                hierarchy[node.type] = node;
+            }
+
+            Arena::current() = saved;
+            return hierarchy;
+        }
+
+        /* The checking passes, in the order they run */
+        void add_passes() {
+            passes.add("populateClassHierarchy", [this]() {
+                populateClassHierarchy();
+                return true;
+            });
+            passes.add("toposort", [this]() { return toposort(); });
+            passes.add("number_types", [this]() {
+                number_types();
+                return true;
+            });
+            passes.add("resolve_methods", [this]() {
+                resolve_methods();
+                return true;
+            });
+            passes.add("resolve_fields", [this]() {
+                resolve_fields();
+                return true;
+            });
+            passes.add("initcheck", [this]() {
+                if (astroot.initcheck(this)) {
+                    report::out() << "INITIALIZATION ERRORS" << endl;
+                    if (listing) { printClassHierarchy(); }
+                    return false;
+                }
+                return true;
+            });
+            passes.add("typeCheck", [this]() {
+                restore_cached();
+                typeCheck();
+                return true;
+            });
+            passes.add("printClassHierarchy", [this]() {
+                if (listing) { printClassHierarchy(); }
+                return true;
+            });
+        }
+
+        void* checkAST() { // top-level
+            add_passes();
+            if (!passes.run(timings)) {
                 return nullptr;
             }
-            typeCheck();
-            printClassHierarchy();
             return &hierarchy;
         }
 }; 
@@ -0,0 +1,240 @@
+//
+// Tests of libquack through its API (Compiler.h): what a caller can
+// tell from a Result.  make test builds and runs them.
+//
+//     api_test [Builtins.h]
+//
+// With the runtime's header, the method slots generated for a class are
+// also checked against those of class_Obj_struct.
+//
+
+#include "../src/Compiler.h"
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+/* A ClassCache in memory */
+class MapCache : public quack::ClassCache {
+    std::map<std::string, std::string> entries_;
+public:
+    bool load(const std::string& key, std::string& entry) override {
+        std::map<std::string, std::string>::iterator found = entries_.find(key);
+        if (found == entries_.end()) { return false; }
+        entry = found->second;
+        return true;
+    }
+    void store(const std::string& key, const std::string& entry) override { entries_[key] = entry; }
+};
+
+static void expect(bool holds, const std::string& what) {
+    if (!holds) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+/* The method slots of class_Obj_struct in the runtime's header, one
+ * declaration each with its spacing evened out; the constructor's is left out.
+ */
+static std::vector<std::string> obj_slots(const std::string& header) {
+    std::ifstream in(header);
+    std::string line;
+    std::vector<std::string> slots;
+    bool inside = false;
+    while (std::getline(in, line)) {
+        if (line.find("struct class_Obj_struct {") != std::string::npos) { inside = true; }
+        else if (inside && line.find("};") != std::string::npos) { break; }
+        else if (inside && line.find("(*") != std::string::npos && line.find("constructor") == std::string::npos) {
+            std::istringstream words(line);
+            std::string word, slot;
+            while (words >> word) { slot += (slot.empty() ? "" : " ") + word; }
+            slots.push_back(slot);
+        }
+    }
+    return slots;
+}
+
+int main(int argc, char** argv) {
+    const std::string program =
+        "class P(x: Int) {\n"
+        "    this.x = x;\n"
+        "    def add(n: Int): Int { return this.x + n; }\n"
+        "    def set(n: Int) { this.x = n; }\n"
+        "}\n"
+        "p = P(1);\n"
+        "y = p.add(2);\n";
+    quack::Result good = quack::compile(program);
+    expect(good.ok, "a well-typed program is ok");
+    expect(!good.c_code.empty(), "a well-typed program has C");
+    expect(good.output.find("\"kind\"") == std::string::npos
+           && good.output.find("CLASS HIERARCHY") == std::string::npos, "nothing is listed by default");
+
+    quack::Options listings;
+    listings.emit = quack::EMIT_AST | quack::EMIT_HIERARCHY | quack::EMIT_C;
+    quack::Result listed = quack::compile(program, listings);
+    expect(listed.output.find("\"kind\"") != std::string::npos, "the AST is listed when asked for");
+    expect(listed.output.find("CLASS HIERARCHY") != std::string::npos, "the hierarchy is listed when asked for");
+    expect(listed.output.find(listed.c_code) != std::string::npos, "the C is listed when asked for");
+    expect(listed.c_code == good.c_code, "listings don't change the C");
+
+    // A method that only reads a field is inferred again once the constructor
+    // has given the field its type, on one thread or several
+    quack::Options threads;
+    threads.check_threads = 4;
+    quack::Result field_reader = quack::compile(program, threads);
+    expect(good.output.find("Error") == std::string::npos, "a well-typed program that reads a field checks without messages");
+    expect(field_reader.ok && field_reader.output == good.output, "it checks the same on several threads");
+
+    // Code generation reads the types checking recorded; it infers none itself
+    quack::Options timed;
+    timed.time_report = 1;
+    quack::Result timed_result = quack::compile(program, timed);
+    long codegen_infers = -1;
+    for (const std::pair<std::string, long>& counter: timed_result.stats.counters) {
+        if (counter.first == "generate_code type_infer") { codegen_infers = counter.second; }
+    }
+    expect(codegen_infers == 0, "code generation infers no types");
+    expect(timed_result.c_code == good.c_code, "timing doesn't change the C");
+
+    // Classes are reused from the cache by the version that stored them, not by
+    // another.  Operators and calls print nothing, so a class with them is stored.
+    const std::string quiet =
+        "class Q(x: Int) {\n"
+        "    this.x = x;\n"
+        "    def four(): Int { y = 1 + 1; return y.PLUS(2); }\n"
+        "}\n"
+        "q = Q(1);\n";
+    MapCache cache;
+    quack::Options cached;
+    cached.cache = &cache;
+    quack::Result stored = quack::compile(quiet, cached);
+    quack::Result reused = quack::compile(quiet, cached);
+    expect(reused.stats.cache_hits == 1 && reused.c_code == stored.c_code, "an unchanged class is reused");
+    quack::Options newer = cached;
+    newer.cache_version = quack::CACHE_VERSION + 1;
+    quack::Result rebuilt = quack::compile(quiet, newer);
+    expect(rebuilt.stats.cache_hits == 0 && rebuilt.ok, "another version's entries are not reused");
+
+    // An if on an Int: the type checker reports it
+    quack::Result type_error = quack::compile(
+        "x = 1;\n"
+        "if x { y = 2; }\n");
+    expect(!type_error.ok, "a program with a type error is not ok");
+    expect(type_error.c_code.empty(), "a program with a type error has no C");
+    expect(type_error.output.find("TypeError (If)") != std::string::npos, "the type error is reported");
+
+    // Checking on several threads finds the same types and reports the
+    // same errors, in the same order, as checking on one
+    const std::string classes =
+        "class A(n: Int) {\n"
+        "    this.n = n;\n"
+        "    def get(): Int { return this.n; }\n"
+        "    def bad(): Int { return \"no\"; }\n"
+        "}\n"
+        "class B(n: Int) extends A {\n"
+        "    this.n = n;\n"
+        "    this.a = A(n);\n"
+        "    def twice(): Int { return this.a.get() + this.n; }\n"
+        "    def worse(): Boolean { return this.a.n; }\n"
+        "}\n"
+        "b = B(3);\n"
+        "x = b.twice();\n";
+    quack::Options one, four;
+    one.emit = four.emit = quack::EMIT_HIERARCHY;
+    four.check_threads = 4;
+    quack::Result serial = quack::compile(classes, one);
+    quack::Result threaded = quack::compile(classes, four);
+    expect(serial.output.find("TypeError (Return)") != std::string::npos, "a unit's type errors are reported");
+    expect(threaded.output == serial.output && threaded.ok == serial.ok,
+           "checking on threads reports what checking on one does");
+
+    // Comparisons call the runtime's LESS and MORE, which Int and String both have
+    quack::Result less = quack::compile(
+        "b = 1 < 2;\n"
+        "c = 2 > 1;\n"
+        "d = \"a\" < \"b\";\n"
+        "e = \"b\" > \"a\";\n");
+    expect(less.ok, "comparisons of Ints and Strings type check");
+    expect(less.c_code.find("->clazz->LESS(") != std::string::npos, "< calls LESS");
+    expect(less.c_code.find("->clazz->MORE(") != std::string::npos, "> calls MORE");
+
+    // Both operands of > are evaluated left to right, side effects and all
+    quack::Result more = quack::compile(
+        "class T() {\n"
+        "    def first(): Int { \"first\".PRINT(); return 1; }\n"
+        "    def second(): Int { \"second\".PRINT(); return 2; }\n"
+        "}\n"
+        "t = T();\n"
+        "m = t.first() > t.second();\n");
+    size_t first = more.c_code.find("->clazz->first(");
+    size_t second = more.c_code.find("->clazz->second(");
+    expect(more.ok && first != std::string::npos && second != std::string::npos && first < second,
+           "the left operand of > is evaluated first");
+
+    // Fields are members of the object's struct, read and written through it
+    expect(good.c_code.find("obj_Int x;") != std::string::npos, "a field is declared in its class's struct");
+    expect(good.c_code.find("->x = ") != std::string::npos, "a field is stored through the object");
+    expect(good.c_code.find("this.x") == std::string::npos, "no variable is named for a field");
+    expect(good.c_code.find("P_method_set(obj_P this, obj_Int var_n) {") != std::string::npos
+           && good.c_code.find("var_this") == std::string::npos, "a method's fields are reached through its receiver");
+
+    // A call without arguments passes just the receiver
+    quack::Result no_args = quack::compile(
+        "x = 1;\n"
+        "s = x.STRING();\n"
+        "s.PRINT();\n");
+    expect(no_args.ok, "calls without arguments type check");
+    expect(no_args.c_code.find("->clazz->STRING(reg__") != std::string::npos
+           && no_args.c_code.find(", );") == std::string::npos, "a call without arguments passes only the receiver");
+
+    quack::Result no_superclass = quack::compile("class C() extends Q { }\n");
+    expect(!no_superclass.ok, "a program whose class extends no class is not ok");
+
+    // Classes are checked in program order, so which undefined superclass is
+    // reported doesn't depend on what earlier compilations interned first
+    quack::compile("Za2 = 1;\n");
+    quack::Result two_undefined = quack::compile(
+        "class Zb2() extends Nope { }\n"
+        "class Za2() extends Nope { }\n");
+    expect(two_undefined.output.find("superclass of Zb2") != std::string::npos,
+           "the first class in the program with an undefined superclass is reported");
+
+    quack::Result cycle = quack::compile(
+        "class A() extends C { }\n"
+        "class B() extends A { }\n"
+        "class C() extends B { }\n");
+    expect(!cycle.ok, "a program whose classes extend each other in a cycle is not ok");
+    expect(cycle.output.find("GRAPH CYCLE DETECTED") != std::string::npos, "the cycle is reported");
+
+    quack::Result syntax_error = quack::compile("x = 1 +;\n");
+    expect(!syntax_error.ok, "a program that doesn't parse is not ok");
+
+    quack::Result bad_escape = quack::compile("s = \"a\\qb\";\n");
+    expect(!bad_escape.ok && bad_escape.c_code.empty(), "a program with a scanner error is not ok");
+    expect(bad_escape.diagnostics.find("Illegal escape code") != std::string::npos,
+           "the scanner error is in the diagnostics");
+
+    // Slots of the class's vtable take the receiver first, as the runtime's do
+    expect(good.c_code.find("obj_Int (*add) (obj_P, obj_Int);") != std::string::npos,
+           "a method's slot takes its class's object, then its formals");
+    if (argc > 1) {
+        std::vector<std::string> slots = obj_slots(argv[1]);
+        expect(slots.size() == 3, "Builtins.h has Obj's three method slots");
+        for (const std::string& slot: slots) {
+            expect(good.c_code.find(slot) != std::string::npos, "an inherited slot is declared as Builtins.h does: " + slot);
+        }
+    }
+
+    if (failures > 0) {
+        std::cerr << failures << " failed" << std::endl;
+        return 1;
+    }
+    std::cout << "api_test: all passed" << std::endl;
+    return 0;
+}
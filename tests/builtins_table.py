@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+#
+# Checks the compiler's table of built-in classes (src/BuiltinClasses.h)
+# against the runtime: each class's method slots, in order, with their
+# return and argument types, must be those of its class_X_struct in
+# Builtins.h, and the function in each slot of the_class_X_struct in
+# Builtins.c must come from the class the table says.
+#
+#     python3 builtins_table.py [repository root]
+#
+# The root defaults to the directory above this script.
+#
+
+import os
+import re
+import sys
+
+
+def table(text):
+    """{class: (parent, [(method, returns, formal, from)])} from BuiltinClasses.h"""
+    arrays = {}
+    for name, body in re.findall(r"constexpr Method (\w+)\[\] = \{(.*?)\n    \};", text, re.S):
+        arrays[name] = [tuple(None if field == "nullptr" else field.strip('"') for field in row)
+                        for row in re.findall(r'\{("\w+"), ("\w+"), (nullptr|"\w+"), ("\w+")\}', body)]
+    classes = {}
+    for name, parent, methods in re.findall(r'\{"(\w+)", (nullptr|"\w+"), (\w+), sizeof', text):
+        classes[name] = (None if parent == "nullptr" else parent.strip('"'), arrays[methods])
+    return classes
+
+
+def runtime(header, source):
+    """{class: [(method, returns, formal, from)]} from Builtins.h and Builtins.c"""
+    classes = {}
+    for name, body in re.findall(r"struct class_(\w+)_struct \{(.*?)\};", header, re.S):
+        slots = re.findall(r"obj_(\w+) \(\*(\w+)\) \(([^)]*)\)", body)
+        methods = []
+        for returns, method, args in slots:
+            if method == "constructor":
+                continue
+            formals = [arg.strip()[len("obj_"):] for arg in args.split(",")[1:]]
+            methods.append([method, returns, formals[0] if formals else None, None])
+        classes[name] = methods
+    for name, body in re.findall(r"struct\s+class_(\w+)_struct\s+the_class_\w+_struct = \{(.*?)\};", source, re.S):
+        filled = re.findall(r"(\w+)_method_(\w+)", body)
+        for slot, (owner, method) in enumerate(filled):
+            if slot < len(classes[name]) and classes[name][slot][0] == method:
+                classes[name][slot][3] = owner
+    return {name: [tuple(m) for m in methods] for name, methods in classes.items()}
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    root = sys.argv[1] if len(sys.argv) > 1 else os.path.join(here, "..")
+    with open(os.path.join(root, "src", "BuiltinClasses.h")) as f:
+        compiler = table(f.read())
+    with open(os.path.join(root, "Builtins.h")) as h, open(os.path.join(root, "Builtins.c")) as c:
+        runtime_classes = runtime(h.read(), c.read())
+    failures = 0
+    for name in sorted(set(compiler) | set(runtime_classes)):
+        if name not in compiler or name not in runtime_classes:
+            print("%s: only in %s" % (name, "the runtime" if name not in compiler else "the compiler"))
+            failures += 1
+            continue
+        if compiler[name][1] != runtime_classes[name]:
+            print("%s: compiler has %s\n%s  runtime has %s"
+                  % (name, compiler[name][1], " " * len(name), runtime_classes[name]))
+            failures += 1
+    print("builtins_table: %s" % ("all match" if failures == 0 else "%d differ" % failures))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
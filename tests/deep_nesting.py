@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+#
+# Stress test for deeply nested programs: the passes keep their own
+# work stacks (see Walk in ASTNode.h), so how deep a program nests
+# should not matter to the C++ stack.  Each program here nests DEPTH
+# levels deep (a million by default) and is compiled with the stack
+# limited to STACK_KB, far less than recursion a level at a time would
+# need.
+#
+#     python3 deep_nesting.py [parser] [depth]
+#
+# parser defaults to ../bin/parser next to this script.  Each program
+# must compile (exit status 0, C written).  Prints the time and peak
+# memory of each.
+#
+
+import os
+import resource
+import subprocess
+import sys
+import tempfile
+import time
+
+STACK_KB = 1024
+
+
+def chain(depth):
+    """x = 1 + 1 + ... : Call::binop nests a Call per term"""
+    return "x = 1" + " + 1" * depth + ";\n"
+
+
+def parentheses(depth):
+    """y = 1 + (1 + (...(1 + 1)...)) : nests the other way, in the parser too"""
+    return "y = " + "1 + (" * depth + "1" + ")" * depth + ";\n"
+
+
+def nots(depth):
+    """y = not not ... x"""
+    return "x = true;\ny = " + "not " * depth + "x;\n"
+
+
+def ifs(depth):
+    """Nested ifs in a method body"""
+    return ("class C() {\n def f(x: Int): Int {\n"
+            + "if x > 0 {\n" * depth + "x = x + 1;\n" + "}\n" * depth
+            + "return x;\n }\n}\n")
+
+
+def classes(depth):
+    """A chain of classes, each extending the one before (depth / 20 of them)"""
+    return "".join("class C%d() extends %s { }\n" % (i, "C%d" % (i - 1) if i > 0 else "Obj")
+                   for i in range(max(depth // 20, 1)))
+
+
+PROGRAMS = [("chain", chain), ("parens", parentheses), ("nots", nots), ("ifs", ifs), ("classes", classes)]
+
+
+def limit_stack():
+    resource.setrlimit(resource.RLIMIT_STACK, (STACK_KB * 1024, STACK_KB * 1024))
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else os.path.join(here, "..", "bin", "parser"))
+    depth = int(sys.argv[2]) if len(sys.argv) > 2 else 1000000
+    failures = 0
+    with tempfile.TemporaryDirectory() as work:
+        for name, make in PROGRAMS:
+            source = os.path.join(work, name + ".qk")
+            with open(source, "w") as out:
+                out.write(make(depth))
+            output = os.path.join(work, "quackmain.c")
+            if os.path.exists(output):
+                os.remove(output)
+            errors = os.path.join(work, name + ".err")
+            start = time.time()
+            with open(errors, "w") as err:
+                child = subprocess.Popen([parser, source], cwd=work, preexec_fn=limit_stack,
+                                         stdout=subprocess.DEVNULL, stderr=err)
+                _, status, usage = os.wait4(child.pid, 0)
+            elapsed = time.time() - start
+            exit_status = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -os.WTERMSIG(status)
+            ok = exit_status == 0 and os.path.exists(output)
+            print("%-10s depth %d: %s, %.1f s, peak RSS %d MB (stack limit %d KB)"
+                  % (name, depth, "ok" if ok else "FAILED (exit %d)" % exit_status,
+                     elapsed, usage.ru_maxrss // 1024, STACK_KB))
+            if not ok:
+                failures += 1
+                with open(errors) as err:
+                    sys.stdout.write(err.read()[-1000:])
+    print("deep_nesting: %s" % ("all passed" if failures == 0 else "%d failed" % failures))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())